@@ -1,17 +1,19 @@
 #ifndef SLOTH_H
 #define SLOTH_H
 
+#include <cstdint>
+#include <cstring>
 #include <memory>
 #include <string>
 #include <vector>
 #include <map>
 #include "bmi.hxx"
-
-#define BMI_TYPE_NAME_DOUBLE "double"
-#define BMI_TYPE_NAME_FLOAT "float"
-#define BMI_TYPE_NAME_INT "int"
-#define BMI_TYPE_NAME_SHORT "short"
-#define BMI_TYPE_NAME_LONG "long"
+#include "sloth_derived.hpp"
+#include "sloth_filter.hpp"
+#include "sloth_kernels.hpp"
+#include "sloth_memory.hpp"
+#include "sloth_shm.hpp"
+#include "sloth_trace.hpp"
 
 class Sloth : public bmi::Bmi {
     public:
@@ -82,19 +84,102 @@ class Sloth : public bmi::Bmi {
         virtual void GetGridFaceNodes(const int grid, int *face_nodes);
         virtual void GetGridNodesPerFace(const int grid, int *nodes_per_face);
 
+        /**
+         * @brief 64-bit sibling of `GetVarNbytes()`, for variables of 2 GiB or more (which `GetVarNbytes()` rejects).
+         */
+        int64_t GetVarNbytes64(std::string name);
+
+        /**
+         * @brief Return the number of items in a variable (its count metadata parameter).
+         */
+        int64_t GetVarItemCount64(std::string name);
 
+        /**
+         * @brief Start recording every BMI call made on this instance to a binary trace file.
+         *
+         * Any trace already being recorded is stopped first. Traces can be replayed against a fresh instance with
+         * the `sloth_replay` tool. Recording can also be enabled with `trace_file=<path>` in the config file passed
+         * to `Initialize()`. Settings read from a config file (other than `trace_file`) are recorded too, so that
+         * replays use them.
+         *
+         * @param path Trace file to create (an existing file is overwritten).
+         */
+        void StartTrace(std::string path);
+
+        /**
+         * @brief Stop recording (if recording) and flush all buffered records to the trace file.
+         */
+        void StopTrace();
+
+        /**
+         * @brief Store the values of all variables in a named POSIX shared-memory segment, for other local processes.
+         *
+         * Must be called before any variables are defined. The segment holds a header, a table describing each
+         * variable and the values themselves (see sloth_shm.hpp), and is published as a consistent time step at the
+         * end of every `UpdateUntil()`. Writes made through pointers from `GetValuePtr()` are not tracked, so they
+         * are only seen consistently if made before the next `UpdateUntil()`. Can also be enabled with
+         * `shm_name=<name>` (and optionally `shm_size=<bytes>`, `shm_max_vars=<count>` and `shm_replace=true`) in
+         * the config file.
+         *
+         * @param name Segment name, e.g. `/sloth-cat-27`. Each instance needs its own name.
+         * @param capacity Size of the segment in bytes.
+         * @param max_vars Maximum number of variables.
+         * @param replace Remove any existing segment with this name (e.g. a stale one from a crashed run) instead of
+         *                throwing. Only use this if no other instance can be using the name.
+         */
+        void EnableSharedMemory(std::string name, size_t capacity = 16 << 20, size_t max_vars = 256, bool replace = false);
+
+        /**
+         * @brief Tune storage and copying of large variables. Affects variables defined after the call.
+         *
+         * Can also be set with `huge_pages`, `copy_threads` and `parallel_copy_threshold` in the config file.
+         *
+         * @param huge_pages Back variables of at least 2 MiB with transparent huge pages (Linux only; not used with
+         *                   shared memory).
+         * @param copy_threads Number of threads to split large `SetValue()`/`GetValue()` copies across, or 0 or 1 to
+         *                     always copy on the calling thread.
+         * @param parallel_copy_threshold Copies of at least this many bytes are split across the copy threads.
+         */
+        void ConfigureLargeArrays(bool huge_pages, size_t copy_threads, size_t parallel_copy_threshold = 64 << 20);
 
     private:
         double current_model_time = 0.0;
 
+        std::unique_ptr<SlothTraceRecorder> trace_recorder;
+        // Nesting depth of traced calls in progress, so only the outermost BMI call is recorded.
+        int trace_depth = 0;
+        // Settings from the last config file read (except `trace_file`), recorded at the start of each trace.
+        std::map<std::string, std::string> config_settings;
+
+        void RecordConfig();
+
         std::map<std::string, std::shared_ptr<void>> var_values;
         std::map<std::string, std::string> var_units;
         std::map<std::string, std::string> var_types;
         std::map<std::string, std::string> var_locations;
-        std::map<std::string, int> var_counts;
+        std::map<std::string, int64_t> var_counts;
         std::map<std::string, std::string> var_innames;
+        // Ingestion filters, by input alias
+        std::map<std::string, SlothFilter> alias_filters;
+
+        /**
+         * A variable computed from another variable in `UpdateUntil()`, see @ref SlothDerived. Implementations are
+         * created (and the source resolved and validated) on the first update after the variable is declared.
+         */
+        struct DerivedVar {
+            std::string name;
+            std::string spec;
+            std::unique_ptr<SlothDerived> impl;
+            void* src = nullptr;
+            void* dest = nullptr;
+        };
+        // In declaration order, which is also update order, so derived variables may be chained.
+        std::vector<DerivedVar> derived_vars;
+
+        // Backing storage for all values, if shared memory is enabled.
+        std::unique_ptr<SlothShmSegment> shm_segment;
         // Number of bytes last stored, or (TODO?) <=0 if passed in by pointer (i.e. we don't own the memory).
-        std::map<std::string, int> var_nbytes; 
+        std::map<std::string, int64_t> var_nbytes; 
 
         std::map<std::string,int> type_sizes = {
             {BMI_TYPE_NAME_DOUBLE, sizeof(double)},
@@ -104,7 +189,21 @@ class Sloth : public bmi::Bmi {
             {BMI_TYPE_NAME_LONG, sizeof(long)}
         };
 
-        int ComputeVarNbytes(std::string name);
+        int64_t ComputeVarNbytes(std::string name);
+
+        bool huge_pages = false;
+        std::unique_ptr<SlothCopyPool> copy_pool;
+        size_t parallel_copy_threshold = 64 << 20;
+
+        /**
+         * @brief `memcpy`, split across the copy pool if the copy is large enough.
+         */
+        void CopyBytes(void* dest, const void* src, size_t nbytes){
+            if(this->copy_pool && nbytes >= this->parallel_copy_threshold)
+                this->copy_pool->Copy(dest, src, nbytes);
+            else
+                std::memcpy(dest, src, nbytes);
+        }
 
         /**
          * Return any output name for an input alias, or if the name is not an alias, return it.
@@ -132,6 +231,30 @@ class Sloth : public bmi::Bmi {
         std::string ProcessNameMeta(std::string nameMaybeWithMeta);
         void EnsureAllocatedForByValue(std::string name);
 
+        /**
+         * @brief Create the implementation for a derived variable, resolving and validating its source.
+         */
+        void BindDerived(DerivedVar& dv);
+
+        /**
+         * @brief Update all derived variables from their sources, in declaration order.
+         */
+        void UpdateDerived();
+
+        /**
+         * @brief Reads `key=value` settings from the config file passed to `Initialize()`.
+         *
+         * Blank lines and lines starting with `#` are ignored. Supported keys:
+         *
+         * * `trace_file` -- see @ref StartTrace
+         * * `shm_name`, `shm_size`, `shm_max_vars`, `shm_replace` (`true`/`false`) -- see @ref EnableSharedMemory
+         * * `filter.<alias>` -- an ingestion filter for input alias `<alias>`, see @ref SlothFilter
+         * * `huge_pages` (`true`/`false`), `copy_threads`, `parallel_copy_threshold` -- see @ref ConfigureLargeArrays
+         *
+         * Unknown keys will throw.
+         */
+        void ReadConfigFile(std::string file);
+
 };
 
 extern "C"
@@ -0,0 +1,45 @@
+#ifndef SLOTH_DERIVED_H
+#define SLOTH_DERIVED_H
+
+#include <cstddef>
+#include <map>
+#include <string>
+
+/**
+ * @brief A parsed derivation, the sixth variable metadata parameter, of the form `op:source[:key=value...]`.
+ *
+ * For example `sum:precip:window=24` or `ewma:temperature:alpha=0.1`.
+ */
+struct SlothDerivedSpec {
+    std::string op;
+    std::string source; // Name of a SLoTH variable or input alias
+    std::map<std::string, std::string> args;
+
+    /**
+     * @brief Parse a derivation string, throwing if it is malformed (unknown ops are not detected here).
+     */
+    static SlothDerivedSpec Parse(const std::string& spec);
+
+    /**
+     * @brief Return argument @p key parsed as a positive integer, @p dflt if it is absent, or throw if it is invalid.
+     */
+    size_t PositiveIntArg(const std::string& key, size_t dflt) const;
+};
+
+/**
+ * @brief A variable whose value is computed from another variable on every time step.
+ *
+ * Instances are created for a particular source and output type and item count, so all validation which depends on
+ * those happens once when they are constructed; @ref Update is then called by `Sloth::UpdateUntil()` each step.
+ */
+class SlothDerived {
+    public:
+        virtual ~SlothDerived() {}
+
+        /**
+         * @brief Fold the current value of the source variable at @p src into the output variable at @p dest.
+         */
+        virtual void Update(const void* src, void* dest) = 0;
+};
+
+#endif //SLOTH_DERIVED_H
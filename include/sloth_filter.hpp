@@ -0,0 +1,53 @@
+#ifndef SLOTH_FILTER_H
+#define SLOTH_FILTER_H
+
+#include <cstddef>
+#include <string>
+
+/**
+ * @brief Cleans values on their way into SLoTH through an input alias, in the same pass as the copy.
+ *
+ * Declared as `key=value` settings separated by `:`, e.g. `nodata=-9999:fill=last:min=0`:
+ *
+ * * `nodata=V` -- treat `V` as missing. NaN is always treated as missing.
+ * * `fill=V` or `fill=last` -- replace missing values with `V`, or leave the last good value in place. Without this,
+ *   missing values are copied unchanged.
+ * * `min=L`, `max=H` -- clamp values to [L, H].
+ */
+class SlothFilter {
+    public:
+        SlothFilter() {}
+
+        /**
+         * @brief Parse a filter declaration, throwing if it is malformed.
+         */
+        explicit SlothFilter(const std::string& spec);
+
+        /**
+         * @brief Filter @p n values of BMI type @p type from @p src into @p dest.
+         *
+         * With `fill=last`, @p dest must hold the previous values.
+         */
+        void Apply(const std::string& type, const void* src, void* dest, size_t n) const;
+
+        /**
+         * @brief Filter @p n values of BMI type @p type from @p src into `dest[inds[i]]`.
+         */
+        void ApplyAtIndices(const std::string& type, const void* src, void* dest, const int* inds, size_t n) const;
+
+    private:
+        bool has_nodata = false;
+        double nodata = 0.0;
+        bool has_fill = false;
+        bool fill_last = false;
+        double fill = 0.0;
+        bool has_min = false;
+        double min = 0.0;
+        bool has_max = false;
+        double max = 0.0;
+
+        template<typename T, typename Index>
+        void ApplyTyped(const T* src, T* dest, size_t n, Index at) const;
+};
+
+#endif //SLOTH_FILTER_H
@@ -0,0 +1,63 @@
+#ifndef SLOTH_KERNELS_H
+#define SLOTH_KERNELS_H
+
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+
+#define BMI_TYPE_NAME_DOUBLE "double"
+#define BMI_TYPE_NAME_FLOAT "float"
+#define BMI_TYPE_NAME_INT "int"
+#define BMI_TYPE_NAME_SHORT "short"
+#define BMI_TYPE_NAME_LONG "long"
+
+#if defined(__GNUC__) || defined(__clang__) || defined(_MSC_VER)
+#define SLOTH_RESTRICT __restrict
+#else
+#define SLOTH_RESTRICT
+#endif
+
+/*
+ * Typed array kernels shared by SLoTH's derived outputs and filters. These are deliberately written as simple,
+ * branch-free loops over `SLOTH_RESTRICT` pointers so that the compiler can auto-vectorize them for every BMI type.
+ */
+
+/**
+ * @brief Call @p f with a value-initialized instance of the C++ type named by a BMI type name and return its result.
+ *
+ * Intended for use with generic lambdas, e.g. `SlothDispatchType(type, [&](auto tag){ using T = decltype(tag); ... })`.
+ * Throws if @p type is not a supported BMI type name.
+ */
+template<typename F>
+auto SlothDispatchType(const std::string& type, F&& f) -> decltype(f(double())) {
+    if(type == BMI_TYPE_NAME_DOUBLE) return f(double());
+    if(type == BMI_TYPE_NAME_FLOAT) return f(float());
+    if(type == BMI_TYPE_NAME_INT) return f(int());
+    if(type == BMI_TYPE_NAME_SHORT) return f(short());
+    if(type == BMI_TYPE_NAME_LONG) return f(long());
+    throw std::runtime_error("Unsupported type \"" + type + "\"");
+}
+
+/**
+ * @brief Convert @p n items of type `T` at @p src to `double` at @p dest.
+ */
+template<typename T>
+void SlothLoadAsDouble(const void* src, double* dest, size_t n){
+    const T* SLOTH_RESTRICT s = static_cast<const T*>(src);
+    double* SLOTH_RESTRICT d = dest;
+    for(size_t i = 0; i < n; ++i)
+        d[i] = static_cast<double>(s[i]);
+}
+
+/**
+ * @brief Convert @p n `double`s at @p src to type `T` at @p dest (integer types are truncated toward zero).
+ */
+template<typename T>
+void SlothStoreFromDouble(const double* src, void* dest, size_t n){
+    const double* SLOTH_RESTRICT s = src;
+    T* SLOTH_RESTRICT d = static_cast<T*>(dest);
+    for(size_t i = 0; i < n; ++i)
+        d[i] = static_cast<T>(s[i]);
+}
+
+#endif //SLOTH_KERNELS_H
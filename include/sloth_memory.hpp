@@ -0,0 +1,63 @@
+#ifndef SLOTH_MEMORY_H
+#define SLOTH_MEMORY_H
+
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#define SLOTH_HUGE_PAGE_SIZE (2 << 20)
+
+/**
+ * @brief Allocate @p nbytes of value storage.
+ *
+ * If @p huge_pages is true and the allocation is at least @ref SLOTH_HUGE_PAGE_SIZE, the memory is mapped aligned to
+ * huge page boundaries and the kernel is advised to back it with transparent huge pages (Linux only; elsewhere, or if
+ * that fails, this falls back to `malloc`). Throws if the memory cannot be allocated.
+ */
+std::shared_ptr<void> SlothAllocate(size_t nbytes, bool huge_pages);
+
+/**
+ * @brief A fixed set of threads which split large `memcpy`s between them.
+ *
+ * The calling thread copies one share itself, so a pool of N threads has N - 1 workers. Copies are not concurrent:
+ * each call blocks until the whole copy is complete.
+ */
+class SlothCopyPool {
+    public:
+        /**
+         * @param threads Total number of threads to copy with, including the caller (at least 2).
+         */
+        explicit SlothCopyPool(size_t threads);
+        ~SlothCopyPool();
+
+        SlothCopyPool(const SlothCopyPool&) = delete;
+        SlothCopyPool& operator=(const SlothCopyPool&) = delete;
+
+        void Copy(void* dest, const void* src, size_t nbytes);
+
+        size_t Threads() const { return this->workers.size() + 1; }
+
+    private:
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable work_cv;
+        std::condition_variable done_cv;
+        uint64_t generation = 0;  // Incremented for each copy, to wake the workers
+        size_t remaining = 0;     // Workers yet to finish the current copy
+        bool stopping = false;
+
+        // The current copy
+        char* dest = nullptr;
+        const char* src = nullptr;
+        size_t nbytes = 0;
+        size_t chunk = 0;
+
+        void CopyChunk(size_t index);
+        void WorkerLoop(size_t index);
+};
+
+#endif //SLOTH_MEMORY_H
@@ -0,0 +1,64 @@
+#ifndef SLOTH_REDUCER_H
+#define SLOTH_REDUCER_H
+
+#include <string>
+#include <vector>
+#include "sloth_derived.hpp"
+
+/**
+ * @brief Return true if @p op names a running statistic implemented by @ref SlothReducer.
+ */
+bool SlothIsReducerOp(const std::string& op);
+
+/**
+ * @brief An element-wise running statistic (`sum`, `mean`, `min`, `max` or `ewma`) of a source variable.
+ *
+ * Each call to @ref Update folds one step of the source into the statistic in O(1) per element (amortized for
+ * sliding-window `min`/`max`, which use the van Herk/Gil-Werman block method). The statistic covers, depending on
+ * the derivation arguments:
+ *
+ * * the whole run (default),
+ * * a sliding window of the last `window=N` steps, or
+ * * the steps since the last reset, with resets every `reset=N` steps.
+ *
+ * `ewma` additionally requires `alpha=a` with 0 < a <= 1 and does not support `window`. State is kept as `double`
+ * regardless of the source and output types.
+ */
+class SlothReducer : public SlothDerived {
+    public:
+        /**
+         * @brief Validate @p spec against the source and output variables and allocate all state.
+         */
+        SlothReducer(const SlothDerivedSpec& spec, const std::string& src_type, size_t src_count,
+                     const std::string& dest_type, size_t dest_count);
+
+        void Update(const void* src, void* dest) override;
+
+    private:
+        enum class Op { Sum, Mean, Min, Max, Ewma };
+
+        Op op;
+        size_t count;
+        size_t window = 0;  // Sliding window length in steps, or 0 for none
+        size_t reset = 0;   // Steps between resets, or 0 for none
+        double alpha = 0.0;
+
+        size_t steps = 0;   // Steps folded in since the last reset (saturates at `window`)
+        size_t pos = 0;     // Current row of `ring`
+
+        std::vector<double> x;       // Current source values
+        std::vector<double> acc;     // Running sum, extreme, or average
+        std::vector<double> result;  // Value to output when it is not `acc` itself
+        std::vector<double> ring;    // `window` rows of `count` values
+        std::vector<double> prefix;  // Extreme of the current block (sliding `min`/`max` only)
+
+        void (*load)(const void*, double*, size_t);
+        void (*store)(const double*, void*, size_t);
+
+        void UpdateSum();
+        template<typename Ext>
+        void UpdateExtreme(Ext ext);
+        void UpdateEwma();
+};
+
+#endif //SLOTH_REDUCER_H
@@ -0,0 +1,68 @@
+#ifndef SLOTH_REMAP_H
+#define SLOTH_REMAP_H
+
+#include <string>
+#include <vector>
+#include "sloth_derived.hpp"
+
+/**
+ * @brief Return true if @p op names an index remapping implemented by @ref SlothRemap.
+ */
+bool SlothIsRemapOp(const std::string& op);
+
+/**
+ * @brief A fixed reordering, subset or aggregation of a source variable, driven by an index map (`map=<variable>`).
+ *
+ * * `gather`: `output[j] = source[map[j]]`; the map has one entry per output item and the types must match.
+ * * `sum_by` / `mean_by`: `output[j]` is the sum / mean of all `source[i]` with `map[i] == j`; the map has one entry
+ *   per source item. Outputs with no sources are 0.
+ *
+ * The map is validated once at construction and compiled into a plan of contiguous runs, so that each update is a
+ * single pass of block copies (or, for fragmented maps, a plain indexed gather loop).
+ */
+class SlothRemap : public SlothDerived {
+    public:
+        /**
+         * @brief Validate @p spec and the index map against the source and output variables and compile the plan.
+         *
+         * @param map Pointer to @p map_count indices of BMI type @p map_type (which must be an integer type).
+         */
+        SlothRemap(const SlothDerivedSpec& spec, const std::string& src_type, size_t src_count,
+                   const std::string& dest_type, size_t dest_count,
+                   const void* map, const std::string& map_type, size_t map_count);
+
+        void Update(const void* src, void* dest) override;
+
+        /**
+         * @brief A run of consecutive source items which map to consecutive (`gather`) or identical (`*_by`) outputs.
+         */
+        struct Run {
+            size_t src;
+            size_t dest;
+            size_t len;
+        };
+
+    private:
+        enum class Op { Gather, SumBy, MeanBy };
+
+        Op op;
+        size_t src_count;
+        size_t dest_count;
+        std::vector<Run> runs;
+        std::vector<size_t> index;      // Per-output source index, used instead of `runs` for fragmented gathers
+        std::vector<double> inv_counts; // 1/(sources per output), `mean_by` only
+
+        std::vector<double> x;
+        std::vector<double> acc;
+
+        void (*gather)(const SlothRemap& plan, const void* src, void* dest) = nullptr;
+        void (*load)(const void*, double*, size_t) = nullptr;
+        void (*store)(const double*, void*, size_t) = nullptr;
+
+        template<typename T>
+        static void GatherRuns(const SlothRemap& plan, const void* src, void* dest);
+        template<typename T>
+        static void GatherIndexed(const SlothRemap& plan, const void* src, void* dest);
+};
+
+#endif //SLOTH_REMAP_H
@@ -0,0 +1,45 @@
+#ifndef SLOTH_REPLAYER_H
+#define SLOTH_REPLAYER_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "bmi.hxx"
+
+#define SLOTH_REPLAY_BUCKETS 64 // Bucket b holds latencies in [2^(b-1), 2^b) ns; bucket 0 holds 0 ns
+
+/**
+ * @brief Latency statistics for one type of call replayed by @ref SlothReplayTrace.
+ */
+struct SlothReplayStats {
+    uint64_t count = 0;
+    uint64_t errors = 0;       // Calls which threw; not included in the latencies
+    uint64_t total_ns = 0;
+    uint64_t max_ns = 0;
+    uint64_t buckets[SLOTH_REPLAY_BUCKETS] = {};
+
+    void Add(uint64_t ns);
+
+    /**
+     * @brief Upper bound of the bucket containing quantile @p q (but never more than the observed maximum).
+     */
+    uint64_t Quantile(double q) const;
+};
+
+/**
+ * @brief Replay one pass of a trace written by @ref SlothTraceRecorder against @p model, as fast as possible.
+ *
+ * @p model should be a fresh instance, as the trace starts from one. Values are not recorded in traces, so set calls
+ * are replayed from a zero-initialized scratch buffer of the recorded size (which get calls also write into).
+ *
+ * Config settings recorded in the trace are written to `<trace_path>.replay.cfg` and passed to the replayed
+ * `Initialize()`, or applied with an untimed `Initialize()` before the first call if the trace was started after
+ * `Initialize()`. A shared-memory segment name gets a `-replay` suffix, so a replay never collides with the recorded
+ * instance's segment. The config file is removed afterwards.
+ *
+ * @param stats Per-call statistics, indexed by @ref SlothTraceCall and accumulated across calls (resized if needed).
+ */
+void SlothReplayTrace(bmi::Bmi& model, const std::string& trace_path, std::vector<SlothReplayStats>& stats);
+
+#endif //SLOTH_REPLAYER_H
@@ -0,0 +1,179 @@
+#ifndef SLOTH_SHM_H
+#define SLOTH_SHM_H
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SLOTH_SHM_MAGIC "SLTHSHM"
+#define SLOTH_SHM_VERSION 1
+#define SLOTH_SHM_ALIGN 64
+
+/*
+ * Layout of a SLoTH shared-memory segment (all offsets are from the start of the segment, in native byte order):
+ *
+ *   SlothShmHeader | SlothShmVar[max_vars] | variable values, each aligned to SLOTH_SHM_ALIGN bytes
+ *
+ * The header's `sequence` is a seqlock: it is odd while the owning model is changing values or adding variables, and
+ * is made even again when the model publishes a completed time step at the end of `UpdateUntil()`. Readers should
+ * load it, wait for it to be even, read what they need, and then check that it has not changed.
+ */
+
+struct SlothShmHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint64_t capacity;         // Size of the whole segment in bytes
+    uint64_t table_offset;
+    uint32_t max_vars;
+    uint32_t var_count;
+    uint64_t data_offset;
+    uint64_t data_used;        // Bytes of the data area allocated so far
+    std::atomic<uint64_t> sequence;
+    double current_time;       // Model time of the last published step
+};
+
+struct SlothShmVar {
+    char name[128];
+    char type[16];
+    char units[64];
+    char location[32];
+    uint64_t count;
+    uint64_t itemsize;
+    uint64_t nbytes;
+    uint64_t offset;           // Offset of the first value
+};
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "Shared-memory sequence counters require lock-free 64-bit atomics");
+
+/**
+ * @brief A named POSIX shared-memory segment which owns the value storage of a @ref Sloth instance.
+ *
+ * The segment is created with a fixed capacity; variables are allocated from it as they are defined and never move,
+ * so pointers from `GetValuePtr()` stay valid. The segment is unlinked when this object is destroyed.
+ */
+class SlothShmSegment {
+    public:
+        /**
+         * @param name Segment name as for `shm_open` (e.g. `/sloth-cat-27`).
+         * @param capacity Total size of the segment in bytes, including header and variable table.
+         * @param max_vars Number of variables the table can describe.
+         * @param replace Remove any existing segment with this name first (e.g. one left behind by a run which did
+         *                not exit cleanly). Otherwise an existing segment, which may be in use, makes this throw.
+         */
+        SlothShmSegment(const std::string& name, size_t capacity, size_t max_vars, bool replace = false);
+        ~SlothShmSegment();
+
+        SlothShmSegment(const SlothShmSegment&) = delete;
+        SlothShmSegment& operator=(const SlothShmSegment&) = delete;
+
+        /**
+         * @brief Describe a new variable in the table and allocate (zeroed) storage for its values.
+         *
+         * Throws if the table or the data area is full, or a name or metadata string is too long.
+         */
+        void* AddVariable(const std::string& name, const std::string& type, const std::string& units,
+                          const std::string& location, uint64_t count, uint64_t itemsize, uint64_t nbytes);
+
+        /**
+         * @brief Mark the segment as being modified (makes the sequence odd) if it is not already.
+         */
+        void BeginWrite(){
+            if(!this->writing){
+                this->writing = true;
+                this->header->sequence.store(this->header->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+                std::atomic_thread_fence(std::memory_order_release);
+            }
+        }
+
+        /**
+         * @brief Mark the current values as a consistent, completed time step (makes the sequence even).
+         */
+        void Publish(double time);
+
+        const std::string& Name() const { return this->name; }
+
+    private:
+        std::string name;
+        size_t capacity;
+        char* base = nullptr;
+        SlothShmHeader* header = nullptr;
+        bool writing = false;
+};
+
+/**
+ * @brief Metadata for one variable found in a shared-memory segment.
+ */
+struct SlothShmVarInfo {
+    std::string name;
+    std::string type;
+    std::string units;
+    std::string location;
+    uint64_t count;
+    uint64_t itemsize;
+    uint64_t nbytes;
+    const void* data;          // Points directly into the mapped segment
+};
+
+/**
+ * @brief Maps another process's SLoTH shared-memory segment read-only.
+ *
+ * Values can be read in place (zero copy) between @ref BeginRead and a successful @ref EndRead, or copied out with
+ * @ref Snapshot.
+ */
+class SlothShmReader {
+    public:
+        explicit SlothShmReader(const std::string& name);
+        ~SlothShmReader();
+
+        SlothShmReader(const SlothShmReader&) = delete;
+        SlothShmReader& operator=(const SlothShmReader&) = delete;
+
+        /**
+         * @brief Wait until no write is in progress and return the (even) sequence number.
+         *
+         * @return The sequence number, or an odd number if @p timeout elapsed while the writer was still busy.
+         */
+        uint64_t BeginRead(std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) const;
+
+        /**
+         * @brief Return true if nothing was modified since @p sequence was returned by @ref BeginRead.
+         */
+        bool EndRead(uint64_t sequence) const;
+
+        /**
+         * @brief Number of steps published so far (half the sequence number).
+         */
+        uint64_t PublishedSteps(uint64_t sequence) const { return sequence / 2; }
+
+        /**
+         * @brief The model time of the last published step. Only meaningful inside a read.
+         */
+        double CurrentTime() const { return this->header->current_time; }
+
+        /**
+         * @brief Describe all variables in the segment. Only meaningful inside a read.
+         */
+        std::vector<SlothShmVarInfo> Variables() const;
+
+        /**
+         * @brief Copy a consistent set of variables and their values, retrying until one is obtained.
+         *
+         * @param vars Receives the variables; their `data` pointers refer to @p values, not the segment.
+         * @param values Receives a copy of each variable's values.
+         * @return The sequence number of the snapshot, or an odd number if no consistent snapshot was obtained
+         *         within @p timeout.
+         */
+        uint64_t Snapshot(std::vector<SlothShmVarInfo>& vars, std::vector<std::vector<char>>& values,
+                          double& time, std::chrono::milliseconds timeout = std::chrono::milliseconds(1000)) const;
+
+    private:
+        size_t size = 0;
+        const char* base = nullptr;
+        const SlothShmHeader* header = nullptr;
+};
+
+#endif //SLOTH_SHM_H
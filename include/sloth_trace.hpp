@@ -0,0 +1,187 @@
+#ifndef SLOTH_TRACE_H
+#define SLOTH_TRACE_H
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#define SLOTH_TRACE_MAGIC "SLTHTRC"
+#define SLOTH_TRACE_VERSION 2
+
+/**
+ * @brief Identifies which BMI call a trace record describes.
+ *
+ * Values are written to trace files, so existing entries must never be renumbered--only append new ones.
+ */
+enum class SlothTraceCall : uint8_t {
+    NameDef = 0, // Not a call: defines the string for a name id used by later records
+    Initialize,
+    Update,
+    UpdateUntil,
+    Finalize,
+    GetValue,
+    GetValuePtr,
+    GetValueAtIndices,
+    SetValue,
+    SetValueAtIndices,
+    GetVarType,
+    GetVarUnits,
+    GetVarItemsize,
+    GetVarNbytes,
+    GetVarLocation,
+    GetInputVarNames,
+    GetOutputVarNames,
+    GetInputItemCount,
+    GetOutputItemCount,
+    GetCurrentTime,
+    Config, // Not a call: one config file setting (`key=value`, as the name) in effect for the calls that follow
+    Count // Not a call: number of entries above
+};
+
+/**
+ * @brief Return a printable name for a @ref SlothTraceCall value.
+ */
+const char* SlothTraceCallName(SlothTraceCall call);
+
+/**
+ * @brief One decoded BMI call from a trace file.
+ */
+struct SlothTraceRecord {
+    SlothTraceCall call;
+    std::string name;          // Variable name exactly as passed by the caller (may include metadata), or empty
+    uint64_t start_ns = 0;     // Start of the call, relative to the start of the trace
+    uint64_t duration_ns = 0;  // Wall time spent in the call when it was recorded
+    uint64_t nbytes = 0;       // Bytes moved by the call (value calls only)
+    std::vector<int> indices;  // Index array passed to `*AtIndices` calls
+    double time = 0.0;         // Target time passed to `UpdateUntil`
+};
+
+/**
+ * @brief Writes a compact binary trace of BMI calls made on a @ref Sloth instance.
+ *
+ * Records are appended to an in-memory buffer on the calling thread; full buffers are handed to a background thread
+ * which does the actual file I/O, so the cost on the calling thread is usually just a few small `memcpy`s. Variable
+ * names are interned--each distinct name is written once as a @ref SlothTraceCall::NameDef record and referenced by
+ * id thereafter.
+ *
+ * File layout (native byte order):
+ *
+ * * Header: 8 byte magic (`SLTHTRC\0`), `uint32` version, `uint32` reserved
+ * * Name definition: `uint8` call (0), `uint32` id, `uint32` length, `length` bytes of name
+ * * Call: `uint8` call, `uint32` name id (or `UINT32_MAX`), `uint64` start ns, `uint64` duration ns, `uint64` nbytes,
+ *   followed by `int32` count and `count` `int32` indices for `*AtIndices` calls, or a `double` time for `UpdateUntil`
+ * * Config setting (version 2 and later): as a call, with call @ref SlothTraceCall::Config and the `key=value` setting
+ *   as its name
+ */
+class SlothTraceRecorder {
+    public:
+        /**
+         * @brief Open (truncating) @p path and start the background writer.
+         *
+         * @param path Trace file to write.
+         * @param buffer_bytes Size at which the in-memory buffer is handed off to the writer thread.
+         */
+        SlothTraceRecorder(const std::string& path, size_t buffer_bytes = 1 << 20);
+
+        /**
+         * @brief Flush all buffered records, stop the writer thread and close the file.
+         */
+        ~SlothTraceRecorder();
+
+        SlothTraceRecorder(const SlothTraceRecorder&) = delete;
+        SlothTraceRecorder& operator=(const SlothTraceRecorder&) = delete;
+
+        /**
+         * @brief Identifies this recorder, unlike its address, which a later recorder may reuse.
+         */
+        uint64_t Id() const { return this->id; }
+
+        /**
+         * @brief Nanoseconds elapsed since this recorder was created.
+         */
+        uint64_t Now() const {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+        }
+
+        /**
+         * @brief Append one call record to the trace.
+         *
+         * Never throws, as it is called from destructors: if the record cannot be buffered (e.g. out of memory) it is
+         * dropped, and @ref Flush reports the error.
+         */
+        void Record(SlothTraceCall call, const std::string& name, uint64_t start_ns, uint64_t duration_ns,
+                    uint64_t nbytes, const int* inds = nullptr, int count = 0, double time = 0.0) noexcept;
+
+        /**
+         * @brief Block until everything recorded so far has been written to the file.
+         *
+         * Throws if any write to the file has failed or any record was dropped (records are dropped rather than
+         * failing the BMI call itself).
+         */
+        void Flush();
+
+    private:
+        std::FILE* file = nullptr;
+        uint64_t id;
+        std::chrono::steady_clock::time_point epoch;
+        size_t buffer_bytes;
+
+        std::vector<char> active;   // Owned by the recording thread
+        std::vector<char> pending;  // Handed off to the writer thread, guarded by `mutex`
+        std::unordered_map<std::string, uint32_t> name_ids;
+
+        std::mutex mutex;
+        std::condition_variable cv;
+        bool stopping = false;
+        bool write_error = false;
+        bool record_error = false;  // Owned by the recording thread
+        std::thread writer;
+
+        uint32_t NameId(const std::string& name);
+        void HandOff();
+        void WriterLoop();
+
+        template<typename T>
+        void Put(const T& v){
+            const char* p = reinterpret_cast<const char*>(&v);
+            active.insert(active.end(), p, p + sizeof(T));
+        }
+};
+
+/**
+ * @brief Sequentially decodes a trace file written by @ref SlothTraceRecorder.
+ */
+class SlothTraceReader {
+    public:
+        /**
+         * @brief Open @p path and validate its header, throwing if it is not a SLoTH trace.
+         */
+        explicit SlothTraceReader(const std::string& path);
+        ~SlothTraceReader();
+
+        SlothTraceReader(const SlothTraceReader&) = delete;
+        SlothTraceReader& operator=(const SlothTraceReader&) = delete;
+
+        /**
+         * @brief Decode the next call record into @p rec, resolving name ids.
+         *
+         * @return false at the end of the trace. Throws if the trace is truncated or corrupt.
+         */
+        bool Next(SlothTraceRecord& rec);
+
+    private:
+        std::FILE* file = nullptr;
+        std::vector<std::string> names;
+
+        template<typename T>
+        bool Get(T& v);
+};
+
+#endif //SLOTH_TRACE_H
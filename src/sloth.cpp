@@ -4,10 +4,14 @@
 // ^ Credit https://www.decompile.com/cpp/faq/file_and_line_error_string.htm
 
 #include "sloth.hpp"
+#include "sloth_filter.hpp"
+#include "sloth_reducer.hpp"
+#include "sloth_remap.hpp"
 
 #include <algorithm>
 #include <cassert>
 #include <cstring>
+#include <fstream>
 #include <math.h>
 #include <stdexcept>
 #include <map>
@@ -15,11 +19,84 @@
 #include <limits>
 //#include <iostream>
 
+namespace {
+  /**
+   * Records one BMI call to the trace recorder (if any) when it goes out of scope. Only the outermost call is
+   * recorded, since several BMI methods are implemented by calling others (e.g. `GetValue` calls `GetVarNbytes`).
+   *
+   * The owning pointer is re-checked at the end of the call, as the call itself may stop or replace the trace (e.g.
+   * `Initialize()` reading a config with `trace_file`); the call is then not recorded in either trace.
+   */
+  class TraceScope {
+    public:
+      TraceScope(std::unique_ptr<SlothTraceRecorder>& owner, int& depth, SlothTraceCall call, const std::string& name = "")
+        : owner(owner), recorder(owner.get()), depth(depth) {
+        if(this->recorder == nullptr)
+          return;
+        this->recorder_id = this->recorder->Id();
+        if(++depth == 1){
+          this->active = true;
+          this->call = call;
+          this->name = name;
+          this->start_ns = this->recorder->Now();
+        }
+      }
+      ~TraceScope(){
+        if(this->recorder == nullptr)
+          return;
+        if(this->active && this->owner && this->owner->Id() == this->recorder_id)
+          this->recorder->Record(this->call, this->name, this->start_ns, this->recorder->Now() - this->start_ns,
+                                 this->nbytes, this->inds, this->count, this->time);
+        --this->depth;
+      }
+
+      bool active = false;
+      // Optional call details, filled in by the traced method
+      uint64_t nbytes = 0;
+      const int* inds = nullptr;
+      int count = 0;
+      double time = 0.0;
+
+    private:
+      std::unique_ptr<SlothTraceRecorder>& owner;
+      SlothTraceRecorder* recorder; // Only dereferenced while `owner` still holds it
+      uint64_t recorder_id = 0;
+      int& depth;
+      SlothTraceCall call = SlothTraceCall::NameDef;
+      std::string name;
+      uint64_t start_ns = 0;
+  };
+
+  /**
+   * Returns the integer config setting @p key (or @p dflt if it is not set), which must be at least @p min.
+   */
+  size_t IntSetting(std::map<std::string, std::string>& settings, const std::string& key, size_t dflt, size_t min,
+                    const std::string& file){
+    auto iter = settings.find(key);
+    if(iter == settings.end()){
+      return dflt;
+    }
+    size_t pos = 0;
+    long long v = -1;
+    try {
+      v = std::stoll(iter->second, &pos);
+    } catch(const std::exception&) {
+      pos = 0;
+    }
+    if(pos == 0 || pos != iter->second.length() || v < 0 || (size_t)v < min){
+      throw std::runtime_error("Setting \"" + key + "\" in config file \"" + file + "\" must be an integer of at least "
+                               + std::to_string(min) + " but is \"" + iter->second + "\" " SOURCE_LOC);
+    }
+    return (size_t)v;
+  }
+}
+
 std::string Sloth::GetComponentName(){
   return "Simple Logical Tautology Handler (SLoTH) Model";
 }
 
 double Sloth::GetCurrentTime(){
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetCurrentTime);
   return current_model_time;
 }
 
@@ -40,21 +117,25 @@ std::string Sloth::GetGridType(const int grid){
 }
 
 std::vector<std::string> Sloth::GetInputVarNames(){ //v?
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetInputVarNames);
   std::set<std::string> ivars;
   for(auto const& iter: this->var_innames)
     ivars.insert(iter.second);
   return std::vector<std::string>(ivars.begin(), ivars.end());
 }
 std::vector<std::string> Sloth::GetOutputVarNames(){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetOutputVarNames);
   std::vector<std::string> ovars;
   for(auto const& iter: this->var_values)
     ovars.push_back(iter.first); 
   return ovars;
 }
 int Sloth::GetInputItemCount(){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetInputItemCount);
   return this->GetInputVarNames().size();
 }
 int Sloth::GetOutputItemCount(){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetOutputItemCount);
   return this->var_values.size();
 }
 
@@ -71,16 +152,21 @@ std::string Sloth::GetTimeUnits(){ //v
 }
 
 void Sloth::GetValue(std::string name, void* dest){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetValue, name);
   name = this->ResolveInNameAlias(name);
 
   void *src;
   src = this->GetValuePtr(name);
 
-  int nbytes = this->GetVarNbytes(name);
-  std::memcpy (dest, src, nbytes);
+  int64_t nbytes = this->GetVarNbytes64(name);
+  this->CopyBytes(dest, src, nbytes);
+  trace.nbytes = nbytes;
 }
 
 void Sloth::GetValueAtIndices(std::string name, void* dest, int* inds, int count){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetValueAtIndices, name);
+  trace.inds = inds;
+  trace.count = count;
   name = this->ResolveInNameAlias(name);
 
   if (count < 1)
@@ -93,11 +179,12 @@ void Sloth::GetValueAtIndices(std::string name, void* dest, int* inds, int count
   char* destbyte = (char*)dest;
 
   int itemsize = this->GetVarItemsize(name);
+  trace.nbytes = (uint64_t)itemsize * count;
 
   for (size_t i = 0; i < count; ++i) {
     std::memcpy(
-      destbyte + (itemsize * i), 
-      srcbyte + (itemsize * inds[i]), 
+      destbyte + ((size_t)itemsize * i), 
+      srcbyte + ((size_t)itemsize * inds[i]), 
       itemsize 
       );
   }
@@ -105,6 +192,7 @@ void Sloth::GetValueAtIndices(std::string name, void* dest, int* inds, int count
 }
 
 void* Sloth::GetValuePtr(std::string name){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetValuePtr, name);
   name = this->ResolveInNameAlias(name);
 
   auto iter = this->var_values.find(name);
@@ -115,6 +203,7 @@ void* Sloth::GetValuePtr(std::string name){ //v
 }
 
 int Sloth::GetVarItemsize(std::string name){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetVarItemsize, name);
   name = this->ResolveInNameAlias(name);
 
   std::map<std::string,int>::const_iterator iter = this->type_sizes.find(this->GetVarType(name));
@@ -125,6 +214,7 @@ int Sloth::GetVarItemsize(std::string name){ //v
 }
 
 std::string Sloth::GetVarLocation(std::string name){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetVarLocation, name);
   name = this->ProcessNameMeta(name);
   name = this->ResolveInNameAlias(name);
 
@@ -136,20 +226,42 @@ std::string Sloth::GetVarLocation(std::string name){ //v
 }
 
 int Sloth::GetVarNbytes(std::string name){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetVarNbytes, name);
+  int64_t nbytes = this->GetVarNbytes64(name);
+  if(nbytes > std::numeric_limits<int>::max()){
+    throw std::runtime_error("Variable \"" + name + "\" is " + std::to_string(nbytes)
+                             + " bytes, too large for GetVarNbytes; use GetVarNbytes64 " SOURCE_LOC);
+  }
+  return (int)nbytes;
+}
+
+int64_t Sloth::GetVarNbytes64(std::string name){
   name = this->ProcessNameMeta(name);
   name = this->ResolveInNameAlias(name);
 
   if(var_nbytes.count(name) <= 0){
     throw std::runtime_error("GetVarNbytes called for non-existent variable "+name+" " SOURCE_LOC);
   }
-  int nbytes = var_nbytes[name];
+  int64_t nbytes = var_nbytes[name];
   if(nbytes <= 0){
     return ComputeVarNbytes(name);
   }
-  return var_nbytes[name];
+  return nbytes;
+}
+
+int64_t Sloth::GetVarItemCount64(std::string name){
+  name = this->ProcessNameMeta(name);
+  name = this->ResolveInNameAlias(name);
+
+  auto iter = this->var_counts.find(name);
+  if(iter == this->var_counts.end()){
+    throw std::runtime_error("GetVarItemCount64 called for non-existent variable "+name+" " SOURCE_LOC);
+  }
+  return iter->second;
 }
 
 std::string Sloth::GetVarType(std::string name){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetVarType, name);
   name = this->ProcessNameMeta(name);
   name = this->ResolveInNameAlias(name);
 
@@ -161,6 +273,7 @@ std::string Sloth::GetVarType(std::string name){ //v
 }
 
 std::string Sloth::GetVarUnits(std::string name){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::GetVarUnits, name);
   name = this->ResolveInNameAlias(name);
 
   auto iter = this->var_units.find(name);
@@ -171,20 +284,36 @@ std::string Sloth::GetVarUnits(std::string name){ //v
 }
 
 void Sloth::Initialize(std::string file){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::Initialize, file);
+  if(file != ""){
+    this->ReadConfigFile(file);
+  }
   this->current_model_time = this->GetStartTime();
 }
 
 void Sloth::SetValueAtIndices(std::string name, int* inds, int count, void* src){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::SetValueAtIndices, name);
+  trace.inds = inds;
+  trace.count = count;
   if (count < 1)
     throw std::runtime_error(std::string("Illegal count ") + std::to_string(count) + std::string(" provided to SetValueAtIndices(name, dest, inds, count)" SOURCE_LOC));
 
   // If this is actually destined for an input alias, punt!...
   auto aliases = this->ResolveInNameAliases(name);
   if(!aliases.empty()){
+    auto filter = this->alias_filters.find(name);
     for(std::string inname : aliases){
+      if(filter != this->alias_filters.end()){
+        if(this->shm_segment)
+          this->shm_segment->BeginWrite();
+        filter->second.ApplyAtIndices(this->var_types[inname], src, this->var_values[inname].get(), inds, count);
+        continue;
+      }
       //TODO: Might be worth wrapping this in try/catch and wrapping any exceptions with a note about the actual name tried...
       this->SetValueAtIndices(inname, inds, count, src);
     }
+    if(trace.active)
+      trace.nbytes = (uint64_t)this->GetVarItemsize(name) * count;
     return;
   }
   // Otherwise...
@@ -193,6 +322,8 @@ void Sloth::SetValueAtIndices(std::string name, int* inds, int count, void* src)
 
   // If this somehow gets called first, we will need space as if we are setting by value. This *should* never happen.
   name = this->ProcessNameMeta(name);
+  if(this->shm_segment)
+    this->shm_segment->BeginWrite();
 
   void *dest;
   dest = this->GetValuePtr(name);
@@ -202,11 +333,12 @@ void Sloth::SetValueAtIndices(std::string name, int* inds, int count, void* src)
   char* destbyte = (char*)dest;
 
   int itemsize = this->GetVarItemsize(name);
+  trace.nbytes = (uint64_t)itemsize * count;
 
   for (size_t i = 0; i < count; ++i) {
     std::memcpy(
-      destbyte + (itemsize * inds[i]), 
-      srcbyte + (itemsize * i), 
+      destbyte + ((size_t)itemsize * inds[i]), 
+      srcbyte + ((size_t)itemsize * i), 
       itemsize 
       );
   }
@@ -214,38 +346,105 @@ void Sloth::SetValueAtIndices(std::string name, int* inds, int count, void* src)
 }
 
 void Sloth::SetValue(std::string name, void* src){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::SetValue, name);
   // If this is actually destined for an input alias, punt!...
   auto aliases = this->ResolveInNameAliases(name);
   if(!aliases.empty()){
+    auto filter = this->alias_filters.find(name);
     for(std::string inname : aliases){
+      if(filter != this->alias_filters.end()){
+        // Filter as part of the copy, rather than copying and then filtering
+        if(this->shm_segment)
+          this->shm_segment->BeginWrite();
+        filter->second.Apply(this->var_types[inname], src, this->var_values[inname].get(), this->var_counts[inname]);
+        continue;
+      }
       //TODO: Might be worth wrapping this in try/catch and wrapping any exceptions with a note about the actual name tried...
       this->SetValue(inname, src);
     }
+    if(trace.active)
+      trace.nbytes = this->GetVarNbytes64(name);
     return;
   }
   // Otherwise...
 
   name = this->ProcessNameMeta(name);
+  if(this->shm_segment)
+    this->shm_segment->BeginWrite();
 
   void *dest = this->GetValuePtr(name);
-  int nbytes = this->GetVarNbytes(name);
-  std::memcpy (dest, src, nbytes);
+  int64_t nbytes = this->GetVarNbytes64(name);
+  this->CopyBytes(dest, src, nbytes);
+  trace.nbytes = nbytes;
 }
 
 void Sloth::Update(){ //v
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::Update);
   this->UpdateUntil(this->current_model_time + this->GetTimeStep());
 }
 
 void Sloth::UpdateUntil(double future_time){ //v
-  if (this->current_model_time != future_time)
+  TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::UpdateUntil);
+  trace.time = future_time;
+  if (this->current_model_time != future_time){
+    if(this->shm_segment)
+      this->shm_segment->BeginWrite();
+    this->UpdateDerived();
     this->current_model_time = future_time;
+  }
+  if(this->shm_segment)
+    this->shm_segment->Publish(this->current_model_time);
 }
 
 void Sloth::Finalize(){ //v
+  {
+    TraceScope trace(this->trace_recorder, this->trace_depth, SlothTraceCall::Finalize);
+  }
+  // Make sure the trace is complete on disk even if the framework never destroys this instance.
+  this->StopTrace();
   //TODO: Consider resetting state here in case the object is reused?
   return;
 }
 
+void Sloth::StartTrace(std::string path){
+  this->StopTrace();
+  this->trace_recorder.reset(new SlothTraceRecorder(path));
+  this->RecordConfig();
+}
+
+void Sloth::RecordConfig(){
+  if(!this->trace_recorder)
+    return;
+  for(auto const& iter: this->config_settings){
+    this->trace_recorder->Record(SlothTraceCall::Config, iter.first + "=" + iter.second, this->trace_recorder->Now(), 0, 0);
+  }
+}
+
+void Sloth::StopTrace(){
+  if(this->trace_recorder){
+    // Release the recorder even if the final flush fails, so BMI calls are no longer traced.
+    std::unique_ptr<SlothTraceRecorder> recorder(std::move(this->trace_recorder));
+    recorder->Flush();
+  }
+}
+
+void Sloth::EnableSharedMemory(std::string name, size_t capacity, size_t max_vars, bool replace){
+  if(!this->var_values.empty()){
+    throw std::runtime_error("Shared memory must be enabled before any variables are defined " SOURCE_LOC);
+  }
+  this->shm_segment.reset(new SlothShmSegment(name, capacity, max_vars, replace));
+}
+
+void Sloth::ConfigureLargeArrays(bool huge_pages, size_t copy_threads, size_t parallel_copy_threshold){
+  this->huge_pages = huge_pages;
+  this->parallel_copy_threshold = parallel_copy_threshold;
+  if(copy_threads < 2){
+    this->copy_pool.reset();
+  } else if(!this->copy_pool || this->copy_pool->Threads() != copy_threads){
+    this->copy_pool.reset(new SlothCopyPool(copy_threads));
+  }
+}
+
 int Sloth::GetGridEdgeCount(const int grid){
   throw std::logic_error("Not implemented." SOURCE_LOC);
 }
@@ -289,18 +488,16 @@ int Sloth::GetVarGrid(std::string name){
   throw std::logic_error("Not implemented." SOURCE_LOC);
 }
 
-int Sloth::ComputeVarNbytes(std::string name){ //v
-  int item_size = this->GetVarItemsize(name);
+int64_t Sloth::ComputeVarNbytes(std::string name){ //v
+  int64_t item_size = this->GetVarItemsize(name);
   // Note that if this name is not already in state that the above call will throw...
-  // so we'll omit checking from here on.
 
-  int item_count;
-  std::map<std::string,int>::const_iterator iter = this->var_counts.find(name);
-  if(iter != this->var_counts.end()){
-    item_count = iter->second;
+  std::map<std::string,int64_t>::const_iterator iter = this->var_counts.find(name);
+  if(iter == this->var_counts.end()){
+    throw std::runtime_error("ComputeVarNbytes called for variable "+name+" with no count " SOURCE_LOC);
   }
 
-  return item_size * item_count;
+  return item_size * iter->second;
 }
 
 std::string Sloth::ProcessNameMeta(std::string name){ //v
@@ -314,11 +511,13 @@ std::string Sloth::ProcessNameMeta(std::string name){ //v
   }
 
   // parse name string for metadata
-  int count = 1;
+  int64_t count = 1;
   std::string type = "double";
   std::string units = "1";
   std::string location = "node";
   std::string inname = "";
+  std::string filter = "";
+  std::string derivation = "";
 
   // parse name string for metadata
   std::string raw_name, tempstr;
@@ -338,7 +537,10 @@ std::string Sloth::ProcessNameMeta(std::string name){ //v
     tempstr = name.substr(lpos+1,rpos-lpos-1);
     //TODO: support whitespace trimming https://www.techiedelight.com/trim-string-cpp-remove-leading-trailing-spaces/
     if(tempstr.length()>0){
-      count = std::stoi(tempstr);
+      count = std::stoll(tempstr);
+      if(count < 0){
+        throw std::runtime_error("Negative count in variable definition '" + name + "' " SOURCE_LOC);
+      }
     }
     lpos = rpos;
     rpos = rppos;
@@ -382,6 +584,29 @@ std::string Sloth::ProcessNameMeta(std::string name){ //v
     tempstr = name.substr(lpos+1,rpos-lpos-1);
     if(tempstr.length()>0){
       inname = tempstr;
+      // An input alias may be followed by an ingestion filter, e.g. "T2D:nodata=-9999:fill=last"
+      if((temppos = inname.find(":")) != std::string::npos){
+        filter = inname.substr(temppos+1);
+        inname = inname.substr(0,temppos);
+        SlothFilter validate(filter);
+      }
+    }
+    lpos = rpos;
+    rpos = rppos;
+
+    if((temppos = name.find(",",lpos+1)) != std::string::npos){
+      rpos = temppos;
+    }
+    tempstr = name.substr(lpos+1,rpos-lpos-1);
+    if(tempstr.length()>0){
+      derivation = tempstr;
+      std::string op = SlothDerivedSpec::Parse(derivation).op;
+      if(!SlothIsReducerOp(op) && !SlothIsRemapOp(op)){
+        throw std::runtime_error("Unknown derivation '" + op + "' specified for variable '" + raw_name + "' " SOURCE_LOC);
+      }
+      if(inname != ""){
+        throw std::runtime_error("Variable \"" + raw_name + "\" cannot have both an input alias and a derivation " SOURCE_LOC);
+      }
     }
 
     // Validate non-collision for inname
@@ -404,6 +629,7 @@ std::string Sloth::ProcessNameMeta(std::string name){ //v
     }
   }
 
+  bool is_new = this->var_values.count(raw_name) == 0;
   var_units[raw_name] = units;
   var_counts[raw_name] = count;
   var_types[raw_name] = type;
@@ -411,8 +637,35 @@ std::string Sloth::ProcessNameMeta(std::string name){ //v
   if(inname != ""){
 	  var_innames[raw_name] = inname;
   }
+  try {
+    this->EnsureAllocatedForByValue(raw_name);
+  } catch(...) {
+    // Undo the definition, so the variable can be defined again (e.g. smaller) rather than being left half-defined.
+    if(is_new){
+      var_units.erase(raw_name);
+      var_counts.erase(raw_name);
+      var_types.erase(raw_name);
+      var_locations.erase(raw_name);
+      var_innames.erase(raw_name);
+      var_nbytes.erase(raw_name);
+    }
+    throw;
+  }
+  if(filter != ""){
+    this->alias_filters[inname] = SlothFilter(filter);
+  }
+  if(derivation != ""){
+    auto iter = std::find_if(this->derived_vars.begin(), this->derived_vars.end(),
+                             [&](const DerivedVar& dv){ return dv.name == raw_name; });
+    if(iter == this->derived_vars.end()){
+      this->derived_vars.emplace_back();
+      iter = this->derived_vars.end() - 1;
+      iter->name = raw_name;
+    }
+    iter->spec = derivation;
+    iter->impl.reset();
+  }
   //std::cerr<<"ProcessNameMeta processed "<<raw_name<<"("<<var_counts[raw_name]<<","<<type<<","<<units<<","<<location<<","<<inname<<")"<<std::endl;
-  this->EnsureAllocatedForByValue(raw_name);
 
   return raw_name;
 }
@@ -437,11 +690,126 @@ std::vector<std::string> Sloth::ResolveInNameAliases(std::string name){
 }
 
 void Sloth::EnsureAllocatedForByValue(std::string name){
-  int nbytes = this->var_nbytes[name]; // Note that this will set a default of zero!
-  if(nbytes == 0){
-    // New varaible! We are setting by value, so set up some memory we will own...
-    //TODO: May need some try/catch/finally to ensure consistency between var_nbytes and var_values?
-    nbytes = this->var_nbytes[name] = this->ComputeVarNbytes(name);
-    this->var_values.emplace(name, std::shared_ptr<void>(std::malloc(nbytes), std::free));
-  }
-}
\ No newline at end of file
+  if(this->var_values.count(name) > 0){
+    return;
+  }
+  // New varaible! We are setting by value, so set up some memory we will own...
+  // Nothing is stored until the allocation succeeds, so a failure leaves no trace of the variable here.
+  int64_t nbytes = this->ComputeVarNbytes(name);
+  std::shared_ptr<void> value;
+  if(this->shm_segment){
+    // The segment owns the memory, and frees it all at once.
+    void* ptr = this->shm_segment->AddVariable(name, this->var_types[name], this->var_units[name], this->var_locations[name],
+                                               this->var_counts[name], this->type_sizes[this->var_types[name]], nbytes);
+    value = std::shared_ptr<void>(ptr, [](void*){});
+  } else {
+    value = SlothAllocate(nbytes, this->huge_pages);
+  }
+  this->var_values.emplace(name, value);
+  this->var_nbytes[name] = nbytes;
+}
+
+void Sloth::ReadConfigFile(std::string file){
+  std::ifstream config(file);
+  if(!config){
+    throw std::runtime_error("Unable to open config file \"" + file + "\" " SOURCE_LOC);
+  }
+  const char* whitespace = " \t\r";
+  std::map<std::string, std::string> settings;
+  std::string line;
+  while(std::getline(config, line)){
+    size_t first = line.find_first_not_of(whitespace);
+    if(first == std::string::npos || line[first] == '#')
+      continue;
+    size_t eqpos = line.find('=');
+    if(eqpos == std::string::npos){
+      throw std::runtime_error("Expected key=value but found \"" + line + "\" in config file \"" + file + "\" " SOURCE_LOC);
+    }
+    std::string key = line.substr(first, eqpos - first);
+    key = key.substr(0, key.find_last_not_of(whitespace) + 1);
+    std::string value = line.substr(eqpos + 1);
+    size_t vfirst = value.find_first_not_of(whitespace);
+    value = vfirst == std::string::npos ? "" : value.substr(vfirst, value.find_last_not_of(whitespace) - vfirst + 1);
+
+    if(key != "trace_file" && key != "shm_name" && key != "shm_size" && key != "shm_max_vars" && key != "shm_replace"
+       && key != "huge_pages" && key != "copy_threads" && key != "parallel_copy_threshold"
+       && key.compare(0, 7, "filter.") != 0){
+      throw std::runtime_error("Unknown setting \"" + key + "\" in config file \"" + file + "\" " SOURCE_LOC);
+    }
+    settings[key] = value;
+  }
+
+  this->config_settings = settings;
+  this->config_settings.erase("trace_file");
+  if(settings.count("trace_file") == 0){
+    this->RecordConfig(); // Otherwise, recorded when the new trace starts
+  }
+
+  // Apply settings only once all are read, as some depend on others.
+  for(auto const& iter: settings){
+    if(iter.first.compare(0, 7, "filter.") == 0){
+      this->alias_filters[iter.first.substr(7)] = SlothFilter(iter.second);
+    }
+  }
+  if(settings.count("trace_file") > 0){
+    this->StartTrace(settings["trace_file"]);
+  }
+  if(settings.count("shm_name") > 0){
+    size_t capacity = IntSetting(settings, "shm_size", 16 << 20, 1, file);
+    size_t max_vars = IntSetting(settings, "shm_max_vars", 256, 1, file);
+    std::string replace = settings.count("shm_replace") > 0 ? settings["shm_replace"] : "false";
+    if(replace != "true" && replace != "false"){
+      throw std::runtime_error("shm_replace must be true or false in config file \"" + file + "\" " SOURCE_LOC);
+    }
+    this->EnableSharedMemory(settings["shm_name"], capacity, max_vars, replace == "true");
+  }
+  if(settings.count("huge_pages") > 0 || settings.count("copy_threads") > 0 || settings.count("parallel_copy_threshold") > 0){
+    std::string huge = settings.count("huge_pages") > 0 ? settings["huge_pages"] : "false";
+    if(huge != "true" && huge != "false"){
+      throw std::runtime_error("huge_pages must be true or false in config file \"" + file + "\" " SOURCE_LOC);
+    }
+    size_t threads = IntSetting(settings, "copy_threads", 0, 0, file);
+    size_t threshold = IntSetting(settings, "parallel_copy_threshold", 64 << 20, 0, file);
+    this->ConfigureLargeArrays(huge == "true", threads, threshold);
+  }
+}
+
+void Sloth::BindDerived(DerivedVar& dv){
+  SlothDerivedSpec spec = SlothDerivedSpec::Parse(dv.spec);
+  std::string source = this->ResolveInNameAlias(spec.source);
+  if(source == dv.name){
+    throw std::runtime_error("Derived variable \"" + dv.name + "\" cannot be derived from itself " SOURCE_LOC);
+  }
+  if(this->var_values.count(source) <= 0){
+    throw std::runtime_error("Source \"" + spec.source + "\" of derived variable \"" + dv.name + "\" does not exist " SOURCE_LOC);
+  }
+
+  if(SlothIsRemapOp(spec.op)){
+    auto iter = spec.args.find("map");
+    if(iter == spec.args.end()){
+      throw std::runtime_error("Derived variable \"" + dv.name + "\" requires an index map (map=<variable>) " SOURCE_LOC);
+    }
+    std::string map = this->ResolveInNameAlias(iter->second);
+    if(this->var_values.count(map) <= 0){
+      throw std::runtime_error("Index map \"" + iter->second + "\" of derived variable \"" + dv.name + "\" does not exist " SOURCE_LOC);
+    }
+    // The map is read (and compiled) only here, so later changes to it have no effect.
+    dv.impl.reset(new SlothRemap(spec, this->var_types[source], this->var_counts[source],
+                                 this->var_types[dv.name], this->var_counts[dv.name],
+                                 this->var_values[map].get(), this->var_types[map], this->var_counts[map]));
+  } else {
+    dv.impl.reset(new SlothReducer(spec, this->var_types[source], this->var_counts[source],
+                                   this->var_types[dv.name], this->var_counts[dv.name]));
+  }
+  dv.src = this->var_values[source].get();
+  dv.dest = this->var_values[dv.name].get();
+}
+
+void Sloth::UpdateDerived(){
+  for(DerivedVar& dv : this->derived_vars){
+    if(!dv.impl){
+      this->BindDerived(dv);
+    }
+    dv.impl->Update(dv.src, dv.dest);
+  }
+}
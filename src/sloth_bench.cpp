@@ -0,0 +1,95 @@
+/**
+ * sloth_bench: Reports `SetValue()`/`GetValue()` copy bandwidth against array size, copying on the calling thread,
+ * with a copy pool (see `Sloth::ConfigureLargeArrays()`), and with a copy pool and huge-page backed storage.
+ *
+ * Usage: sloth_bench [max_bytes] [threads]
+ *
+ * Sizes double from 4 KiB up to max_bytes (default 256 MiB). threads defaults to the number of hardware threads.
+ * Bandwidth counts each byte once per copy.
+ */
+#include "sloth.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+  struct Mode {
+    const char* name;
+    bool huge_pages;
+    bool pool;
+  };
+
+  // Measures SetValue and GetValue bandwidth (GB/s) for a variable of nbytes
+  void Measure(const Mode& mode, size_t threads, size_t nbytes, double& set_gbps, double& get_gbps){
+    Sloth sloth;
+    // A threshold of zero means every copy in the pool modes uses the pool, so the table shows where it pays off.
+    sloth.ConfigureLargeArrays(mode.huge_pages, mode.pool ? threads : 0, 0);
+    std::string name = "bench(" + std::to_string(nbytes / sizeof(double)) + ",double,1,node)";
+    sloth.GetVarNbytes64(name);
+    std::vector<char> buffer(nbytes, 1);
+
+    // Enough repetitions to copy ~1 GiB, and at least a few
+    size_t reps = std::max<size_t>(3, (size_t(1) << 30) / nbytes);
+    sloth.SetValue("bench", buffer.data()); // Fault in the pages
+    sloth.GetValue("bench", buffer.data());
+
+    auto start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < reps; ++i)
+      sloth.SetValue("bench", buffer.data());
+    double set_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    start = std::chrono::steady_clock::now();
+    for(size_t i = 0; i < reps; ++i)
+      sloth.GetValue("bench", buffer.data());
+    double get_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    set_gbps = (double)nbytes * reps / set_s / 1e9;
+    get_gbps = (double)nbytes * reps / get_s / 1e9;
+  }
+}
+
+int main(int argc, char** argv){
+  size_t max_bytes = argc > 1 ? std::strtoull(argv[1], nullptr, 10) : size_t(256) << 20;
+  size_t threads = argc > 2 ? std::strtoull(argv[2], nullptr, 10) : std::thread::hardware_concurrency();
+  if(argc > 3 || max_bytes < 4096){
+    std::fprintf(stderr, "Usage: %s [max_bytes (at least 4096)] [threads]\n", argv[0]);
+    return 2;
+  }
+  threads = std::max<size_t>(threads, 2);
+
+  const Mode modes[] = {
+    { "serial", false, false },
+    { "pool", false, true },
+    { "pool+thp", true, true },
+  };
+
+  std::printf("%14s", "bytes");
+  for(const Mode& mode : modes)
+    std::printf("  %10s set  %10s get", mode.name, mode.name);
+  std::printf("   (GB/s, %zu copy threads)\n", threads);
+
+  try {
+    for(size_t nbytes = 4096; nbytes <= max_bytes; nbytes *= 2){
+      std::printf("%14zu", nbytes);
+      for(const Mode& mode : modes){
+        double set_gbps, get_gbps;
+        Measure(mode, threads, nbytes, set_gbps, get_gbps);
+        std::printf("  %14.2f  %14.2f", set_gbps, get_gbps);
+      }
+      std::printf("\n");
+      std::fflush(stdout);
+    }
+  } catch(const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
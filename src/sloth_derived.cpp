@@ -0,0 +1,53 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_derived.hpp"
+
+#include <stdexcept>
+
+SlothDerivedSpec SlothDerivedSpec::Parse(const std::string& spec){
+  SlothDerivedSpec retval;
+  size_t start = 0, end;
+  int field = 0;
+  do {
+    end = spec.find(":", start);
+    std::string tempstr = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    if(field == 0){
+      retval.op = tempstr;
+    } else if(field == 1){
+      retval.source = tempstr;
+    } else {
+      size_t eqpos = tempstr.find("=");
+      if(eqpos == std::string::npos || eqpos == 0){
+        throw std::runtime_error("Expected key=value but found \"" + tempstr + "\" in derivation \"" + spec + "\" " SOURCE_LOC);
+      }
+      retval.args[tempstr.substr(0, eqpos)] = tempstr.substr(eqpos + 1);
+    }
+    ++field;
+    start = end + 1;
+  } while(end != std::string::npos);
+
+  if(retval.op.empty() || retval.source.empty()){
+    throw std::runtime_error("Derivation \"" + spec + "\" must be of the form op:source[:key=value...] " SOURCE_LOC);
+  }
+  return retval;
+}
+
+size_t SlothDerivedSpec::PositiveIntArg(const std::string& key, size_t dflt) const {
+  auto iter = this->args.find(key);
+  if(iter == this->args.end()){
+    return dflt;
+  }
+  size_t pos = 0;
+  long long v = 0;
+  try {
+    v = std::stoll(iter->second, &pos);
+  } catch(const std::exception&) {
+    pos = 0;
+  }
+  if(pos == 0 || pos != iter->second.length() || v <= 0){
+    throw std::runtime_error("Derivation argument \"" + key + "\" must be a positive integer but is \"" + iter->second + "\" " SOURCE_LOC);
+  }
+  return (size_t)v;
+}
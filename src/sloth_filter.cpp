@@ -0,0 +1,144 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_filter.hpp"
+#include "sloth_kernels.hpp"
+
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+  double ParseNumber(const std::string& key, const std::string& value){
+    size_t pos = 0;
+    double v = 0.0;
+    try {
+      v = std::stod(value, &pos);
+    } catch(const std::exception&) {
+      pos = 0;
+    }
+    if(pos == 0 || pos != value.length()){
+      throw std::runtime_error("Filter setting \"" + key + "\" must be a number but is \"" + value + "\" " SOURCE_LOC);
+    }
+    return v;
+  }
+
+  // Convert a bound to type T, saturating rather than overflowing for integer types.
+  template<typename T>
+  T Saturate(double v){
+    if(std::is_integral<T>::value){
+      if(!(v > (double)std::numeric_limits<T>::lowest())) return std::numeric_limits<T>::lowest();
+      if(!(v < (double)std::numeric_limits<T>::max())) return std::numeric_limits<T>::max();
+    }
+    return static_cast<T>(v);
+  }
+
+  // Destination index of the i'th source value: the same index, or one from an index array.
+  struct Contiguous {
+    size_t operator()(size_t i) const { return i; }
+  };
+  struct Indexed {
+    const int* inds;
+    size_t operator()(size_t i) const { return (size_t)inds[i]; }
+  };
+
+  // True if v is exactly a value of type T (so that comparing against it can ever match).
+  template<typename T>
+  bool Representable(double v){
+    if(!std::is_integral<T>::value) return true;
+    return v >= (double)std::numeric_limits<T>::lowest() && v <= (double)std::numeric_limits<T>::max()
+           && static_cast<double>(static_cast<T>(v)) == v;
+  }
+}
+
+SlothFilter::SlothFilter(const std::string& spec){
+  size_t start = 0, end;
+  do {
+    end = spec.find(":", start);
+    std::string tempstr = spec.substr(start, end == std::string::npos ? std::string::npos : end - start);
+    start = end + 1;
+    size_t eqpos = tempstr.find("=");
+    if(eqpos == std::string::npos){
+      throw std::runtime_error("Expected key=value but found \"" + tempstr + "\" in filter \"" + spec + "\" " SOURCE_LOC);
+    }
+    std::string key = tempstr.substr(0, eqpos);
+    std::string value = tempstr.substr(eqpos + 1);
+    if(key == "nodata"){
+      this->has_nodata = true;
+      this->nodata = ParseNumber(key, value);
+    } else if(key == "fill"){
+      this->has_fill = true;
+      this->fill_last = value == "last";
+      if(!this->fill_last)
+        this->fill = ParseNumber(key, value);
+    } else if(key == "min"){
+      this->has_min = true;
+      this->min = ParseNumber(key, value);
+    } else if(key == "max"){
+      this->has_max = true;
+      this->max = ParseNumber(key, value);
+    } else {
+      throw std::runtime_error("Unknown filter setting \"" + key + "\" in filter \"" + spec + "\" " SOURCE_LOC);
+    }
+  } while(end != std::string::npos);
+
+  if(this->has_min && this->has_max && this->min > this->max){
+    throw std::runtime_error("Filter \"" + spec + "\" has min greater than max " SOURCE_LOC);
+  }
+}
+
+void SlothFilter::Apply(const std::string& type, const void* src, void* dest, size_t n) const {
+  SlothDispatchType(type, [&](auto tag){
+    using T = decltype(tag);
+    this->ApplyTyped(static_cast<const T*>(src), static_cast<T*>(dest), n, Contiguous());
+  });
+}
+
+void SlothFilter::ApplyAtIndices(const std::string& type, const void* src, void* dest, const int* inds, size_t n) const {
+  SlothDispatchType(type, [&](auto tag){
+    using T = decltype(tag);
+    this->ApplyTyped(static_cast<const T*>(src), static_cast<T*>(dest), n, Indexed{ inds });
+  });
+}
+
+template<typename T, typename Index>
+void SlothFilter::ApplyTyped(const T* src, T* dest, size_t n, Index at) const {
+  const T* SLOTH_RESTRICT s = src;
+  T* SLOTH_RESTRICT d = dest;
+  const T lo = this->has_min ? Saturate<T>(this->min) : std::numeric_limits<T>::lowest();
+  const T hi = this->has_max ? Saturate<T>(this->max) : std::numeric_limits<T>::max();
+  const bool check_nodata = this->has_nodata && Representable<T>(this->nodata);
+  const T nd = check_nodata ? static_cast<T>(this->nodata) : T();
+
+  // Each loop is branch-free (selects only) so the contiguous case vectorizes; `x != x` is the NaN test.
+  if(!this->has_fill){
+    // Missing values pass through unchanged, rather than being clamped into plausible-looking ones.
+    for(size_t i = 0; i < n; ++i){
+      const T x = s[i];
+      const bool missing = (check_nodata & (x == nd)) | (x != x);
+      T y = x < lo ? lo : x;
+      y = y > hi ? hi : y;
+      d[at(i)] = missing ? x : y;
+    }
+  } else if(this->fill_last){
+    for(size_t i = 0; i < n; ++i){
+      const T x = s[i];
+      const bool missing = (check_nodata & (x == nd)) | (x != x);
+      T y = missing ? d[at(i)] : x;
+      y = y < lo ? lo : y;
+      y = y > hi ? hi : y;
+      d[at(i)] = y;
+    }
+  } else {
+    const T f = Saturate<T>(this->fill);
+    for(size_t i = 0; i < n; ++i){
+      const T x = s[i];
+      const bool missing = (check_nodata & (x == nd)) | (x != x);
+      T y = missing ? f : x;
+      y = y < lo ? lo : y;
+      y = y > hi ? hi : y;
+      d[at(i)] = y;
+    }
+  }
+}
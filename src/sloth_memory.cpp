@@ -0,0 +1,112 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_memory.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+  // Chunks are multiples of this, so each thread's share starts on its own cache lines (and usually pages).
+  const size_t CHUNK_ALIGN = 4096;
+}
+
+std::shared_ptr<void> SlothAllocate(size_t nbytes, bool huge_pages){
+#ifdef __linux__
+  if(huge_pages && nbytes >= SLOTH_HUGE_PAGE_SIZE){
+    // Over-map by one huge page so the region can be trimmed to start and end on huge page boundaries.
+    size_t len = (nbytes + SLOTH_HUGE_PAGE_SIZE - 1) / SLOTH_HUGE_PAGE_SIZE * SLOTH_HUGE_PAGE_SIZE;
+    void* p = mmap(nullptr, len + SLOTH_HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(p != MAP_FAILED){
+      uintptr_t start = (uintptr_t)p;
+      uintptr_t aligned = (start + SLOTH_HUGE_PAGE_SIZE - 1) / SLOTH_HUGE_PAGE_SIZE * SLOTH_HUGE_PAGE_SIZE;
+      if(aligned > start)
+        munmap(p, aligned - start);
+      if(start + SLOTH_HUGE_PAGE_SIZE > aligned)
+        munmap((void*)(aligned + len), start + SLOTH_HUGE_PAGE_SIZE - aligned);
+      madvise((void*)aligned, len, MADV_HUGEPAGE); // Only advice: failure just means normal pages
+      return std::shared_ptr<void>((void*)aligned, [len](void* q){ munmap(q, len); });
+    }
+  }
+#endif
+  void* p = std::malloc(nbytes);
+  if(p == nullptr && nbytes > 0){
+    throw std::runtime_error("Unable to allocate " + std::to_string(nbytes) + " bytes " SOURCE_LOC);
+  }
+  return std::shared_ptr<void>(p, std::free);
+}
+
+SlothCopyPool::SlothCopyPool(size_t threads){
+  if(threads < 2){
+    throw std::runtime_error("A copy pool needs at least 2 threads " SOURCE_LOC);
+  }
+  for(size_t i = 1; i < threads; ++i){
+    this->workers.emplace_back(&SlothCopyPool::WorkerLoop, this, i);
+  }
+}
+
+SlothCopyPool::~SlothCopyPool(){
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->work_cv.notify_all();
+  for(std::thread& t : this->workers){
+    t.join();
+  }
+}
+
+void SlothCopyPool::Copy(void* dest, const void* src, size_t nbytes){
+  size_t threads = this->Threads();
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->dest = static_cast<char*>(dest);
+    this->src = static_cast<const char*>(src);
+    this->nbytes = nbytes;
+    // Round the share up (never down), so that chunk * threads >= nbytes and every byte is copied.
+    size_t share = (nbytes + threads - 1) / threads;
+    this->chunk = (share + CHUNK_ALIGN - 1) / CHUNK_ALIGN * CHUNK_ALIGN;
+    this->remaining = this->workers.size();
+    ++this->generation;
+  }
+  this->work_cv.notify_all();
+
+  this->CopyChunk(0);
+
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->done_cv.wait(lock, [this]{ return this->remaining == 0; });
+}
+
+void SlothCopyPool::CopyChunk(size_t index){
+  size_t begin = index * this->chunk;
+  if(begin < this->nbytes){
+    size_t len = std::min(this->chunk, this->nbytes - begin);
+    std::memcpy(this->dest + begin, this->src + begin, len);
+  }
+}
+
+void SlothCopyPool::WorkerLoop(size_t index){
+  uint64_t seen = 0;
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while(true){
+    this->work_cv.wait(lock, [&]{ return this->generation != seen || this->stopping; });
+    if(this->stopping){
+      return;
+    }
+    seen = this->generation;
+    lock.unlock();
+    this->CopyChunk(index);
+    lock.lock();
+    if(--this->remaining == 0){
+      this->done_cv.notify_one();
+    }
+  }
+}
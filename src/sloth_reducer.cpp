@@ -0,0 +1,206 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_reducer.hpp"
+#include "sloth_kernels.hpp"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+bool SlothIsReducerOp(const std::string& op){
+  return op == "sum" || op == "mean" || op == "min" || op == "max" || op == "ewma";
+}
+
+SlothReducer::SlothReducer(const SlothDerivedSpec& spec, const std::string& src_type, size_t src_count,
+                           const std::string& dest_type, size_t dest_count){
+  if(spec.op == "sum") this->op = Op::Sum;
+  else if(spec.op == "mean") this->op = Op::Mean;
+  else if(spec.op == "min") this->op = Op::Min;
+  else if(spec.op == "max") this->op = Op::Max;
+  else if(spec.op == "ewma") this->op = Op::Ewma;
+  else throw std::runtime_error("Unknown running statistic \"" + spec.op + "\" " SOURCE_LOC);
+
+  if(src_count != dest_count){
+    throw std::runtime_error("Running " + spec.op + " of \"" + spec.source + "\" must have the same item count as its source ("
+                             + std::to_string(src_count) + ") but has " + std::to_string(dest_count) + " " SOURCE_LOC);
+  }
+  for(auto const& iter: spec.args){
+    if(iter.first != "window" && iter.first != "reset" && iter.first != "alpha"){
+      throw std::runtime_error("Unknown argument \"" + iter.first + "\" for running " + spec.op + " " SOURCE_LOC);
+    }
+  }
+  this->count = dest_count;
+  this->window = spec.PositiveIntArg("window", 0);
+  this->reset = spec.PositiveIntArg("reset", 0);
+  if(this->window != 0 && this->reset != 0){
+    throw std::runtime_error("Running " + spec.op + " cannot have both a window and a reset interval " SOURCE_LOC);
+  }
+
+  if(this->op == Op::Ewma){
+    if(this->window != 0){
+      throw std::runtime_error("Running ewma does not support a window (use reset instead) " SOURCE_LOC);
+    }
+    auto iter = spec.args.find("alpha");
+    size_t pos = 0;
+    try {
+      if(iter != spec.args.end())
+        this->alpha = std::stod(iter->second, &pos);
+    } catch(const std::exception&) {
+      pos = 0;
+    }
+    if(pos == 0 || pos != iter->second.length() || !(this->alpha > 0.0 && this->alpha <= 1.0)){
+      throw std::runtime_error("Running ewma requires an argument alpha with 0 < alpha <= 1 " SOURCE_LOC);
+    }
+  } else if(spec.args.count("alpha") > 0){
+    throw std::runtime_error("Argument alpha is only allowed for running ewma " SOURCE_LOC);
+  }
+
+  this->load = SlothDispatchType(src_type, [](auto tag){ return &SlothLoadAsDouble<decltype(tag)>; });
+  this->store = SlothDispatchType(dest_type, [](auto tag){ return &SlothStoreFromDouble<decltype(tag)>; });
+
+  this->x.resize(this->count);
+  this->acc.resize(this->count, 0.0);
+  bool windowed_extreme = this->window != 0 && (this->op == Op::Min || this->op == Op::Max);
+  if(this->op == Op::Mean || windowed_extreme){
+    this->result.resize(this->count);
+  }
+  if(this->window != 0){
+    // Sliding extremes start out as if the window were full of values that can never win.
+    double init = 0.0;
+    if(this->op == Op::Min) init = std::numeric_limits<double>::infinity();
+    if(this->op == Op::Max) init = -std::numeric_limits<double>::infinity();
+    this->ring.resize(this->window * this->count, init);
+  }
+  if(windowed_extreme){
+    this->prefix.resize(this->count);
+  }
+}
+
+void SlothReducer::Update(const void* src, void* dest){
+  if(this->reset != 0 && this->steps == this->reset){
+    this->steps = 0;
+    std::fill(this->acc.begin(), this->acc.end(), 0.0);
+  }
+
+  this->load(src, this->x.data(), this->count);
+  switch(this->op){
+    case Op::Sum:
+    case Op::Mean:
+      this->UpdateSum();
+      break;
+    case Op::Min:
+      this->UpdateExtreme([](double a, double b){ return b < a ? b : a; });
+      break;
+    case Op::Max:
+      this->UpdateExtreme([](double a, double b){ return b > a ? b : a; });
+      break;
+    case Op::Ewma:
+      this->UpdateEwma();
+      break;
+  }
+
+  const double* out = this->result.empty() ? this->acc.data() : this->result.data();
+  this->store(out, dest, this->count);
+}
+
+void SlothReducer::UpdateSum(){
+  const size_t n = this->count;
+  const double* SLOTH_RESTRICT xs = this->x.data();
+  double* SLOTH_RESTRICT a = this->acc.data();
+
+  if(this->window != 0){
+    double* SLOTH_RESTRICT row = this->ring.data() + this->pos * n;
+    for(size_t i = 0; i < n; ++i){
+      a[i] += xs[i] - row[i];
+      row[i] = xs[i];
+    }
+    this->pos = (this->pos + 1) % this->window;
+    if(this->pos == 0){
+      // Once per window, recompute the sums exactly so round-off (or a NaN) cannot accumulate forever.
+      std::fill(this->acc.begin(), this->acc.end(), 0.0);
+      for(size_t r = 0; r < this->window; ++r){
+        const double* SLOTH_RESTRICT rrow = this->ring.data() + r * n;
+        for(size_t i = 0; i < n; ++i)
+          a[i] += rrow[i];
+      }
+    }
+    if(this->steps < this->window)
+      ++this->steps;
+  } else {
+    for(size_t i = 0; i < n; ++i)
+      a[i] += xs[i];
+    ++this->steps;
+  }
+
+  if(this->op == Op::Mean){
+    const double inv = 1.0 / this->steps;
+    double* SLOTH_RESTRICT r = this->result.data();
+    for(size_t i = 0; i < n; ++i)
+      r[i] = a[i] * inv;
+  }
+}
+
+template<typename Ext>
+void SlothReducer::UpdateExtreme(Ext ext){
+  const size_t n = this->count;
+  const double* SLOTH_RESTRICT xs = this->x.data();
+
+  if(this->window == 0){
+    double* SLOTH_RESTRICT a = this->acc.data();
+    if(this->steps == 0){
+      std::copy(xs, xs + n, a);
+    } else {
+      for(size_t i = 0; i < n; ++i)
+        a[i] = ext(a[i], xs[i]);
+    }
+    ++this->steps;
+    return;
+  }
+
+  // The window is the last `window` steps: the tail of the previous block of `window` steps plus the current block so
+  // far. Rows of `ring` after `pos` hold suffix extremes of the previous block; `prefix` is the current block's extreme.
+  const size_t p = this->pos;
+  double* SLOTH_RESTRICT pre = this->prefix.data();
+  double* SLOTH_RESTRICT r = this->result.data();
+  if(p == 0){
+    std::copy(xs, xs + n, pre);
+  } else {
+    for(size_t i = 0; i < n; ++i)
+      pre[i] = ext(pre[i], xs[i]);
+  }
+  if(p + 1 < this->window){
+    const double* SLOTH_RESTRICT suffix = this->ring.data() + (p + 1) * n;
+    for(size_t i = 0; i < n; ++i)
+      r[i] = ext(suffix[i], pre[i]);
+  } else {
+    std::copy(pre, pre + n, r);
+  }
+  std::copy(xs, xs + n, this->ring.data() + p * n);
+
+  if(p + 1 == this->window){
+    // Block complete: turn its raw values into suffix extremes, in place, for use during the next block.
+    for(size_t k = this->window - 1; k-- > 0;){
+      double* SLOTH_RESTRICT row = this->ring.data() + k * n;
+      const double* SLOTH_RESTRICT next = row + n;
+      for(size_t i = 0; i < n; ++i)
+        row[i] = ext(row[i], next[i]);
+    }
+  }
+  this->pos = (p + 1) % this->window;
+}
+
+void SlothReducer::UpdateEwma(){
+  const size_t n = this->count;
+  const double* SLOTH_RESTRICT xs = this->x.data();
+  double* SLOTH_RESTRICT a = this->acc.data();
+  if(this->steps == 0){
+    std::copy(xs, xs + n, a);
+  } else {
+    const double alpha = this->alpha;
+    for(size_t i = 0; i < n; ++i)
+      a[i] += alpha * (xs[i] - a[i]);
+  }
+  ++this->steps;
+}
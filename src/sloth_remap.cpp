@@ -0,0 +1,156 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_remap.hpp"
+#include "sloth_kernels.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <type_traits>
+
+namespace {
+  // Gathers with more runs than this fraction of their items are done with an indexed loop instead.
+  const size_t FRAGMENTED_RUNS_DIVISOR = 4;
+
+  template<typename T>
+  std::vector<long long> ReadMap(const void* map, size_t map_count, std::true_type){
+    const T* m = static_cast<const T*>(map);
+    return std::vector<long long>(m, m + map_count);
+  }
+
+  template<typename T>
+  std::vector<long long> ReadMap(const void*, size_t, std::false_type){
+    throw std::runtime_error("Index maps must have an integer type " SOURCE_LOC);
+  }
+}
+
+bool SlothIsRemapOp(const std::string& op){
+  return op == "gather" || op == "sum_by" || op == "mean_by";
+}
+
+SlothRemap::SlothRemap(const SlothDerivedSpec& spec, const std::string& src_type, size_t src_count,
+                       const std::string& dest_type, size_t dest_count,
+                       const void* map, const std::string& map_type, size_t map_count)
+  : src_count(src_count), dest_count(dest_count) {
+  if(spec.op == "gather") this->op = Op::Gather;
+  else if(spec.op == "sum_by") this->op = Op::SumBy;
+  else if(spec.op == "mean_by") this->op = Op::MeanBy;
+  else throw std::runtime_error("Unknown remap \"" + spec.op + "\" " SOURCE_LOC);
+
+  for(auto const& iter: spec.args){
+    if(iter.first != "map"){
+      throw std::runtime_error("Unknown argument \"" + iter.first + "\" for " + spec.op + " " SOURCE_LOC);
+    }
+  }
+
+  std::vector<long long> m = SlothDispatchType(map_type, [&](auto tag){
+    using T = decltype(tag);
+    return ReadMap<T>(map, map_count, std::is_integral<T>());
+  });
+
+  // Validate the map once, up front, so updates never need to check indices.
+  size_t expected_count = this->op == Op::Gather ? dest_count : src_count;
+  size_t index_limit = this->op == Op::Gather ? src_count : dest_count;
+  if(map_count != expected_count){
+    throw std::runtime_error("Index map for " + spec.op + " of \"" + spec.source + "\" must have "
+                             + std::to_string(expected_count) + " items but has " + std::to_string(map_count) + " " SOURCE_LOC);
+  }
+  for(size_t i = 0; i < map_count; ++i){
+    if(m[i] < 0 || (size_t)m[i] >= index_limit){
+      throw std::runtime_error("Index map for " + spec.op + " of \"" + spec.source + "\" has out of range index "
+                               + std::to_string(m[i]) + " at position " + std::to_string(i) + " " SOURCE_LOC);
+    }
+  }
+
+  if(this->op == Op::Gather){
+    if(src_type != dest_type){
+      throw std::runtime_error("gather of \"" + spec.source + "\" must have the same type as its source (" + src_type + ") " SOURCE_LOC);
+    }
+    // Runs of consecutive outputs taken from consecutive source items become block copies.
+    for(size_t j = 0; j < map_count; ++j){
+      if(!this->runs.empty() && (size_t)m[j] == this->runs.back().src + this->runs.back().len){
+        ++this->runs.back().len;
+      } else {
+        this->runs.push_back({ (size_t)m[j], j, 1 });
+      }
+    }
+    if(this->runs.size() > map_count / FRAGMENTED_RUNS_DIVISOR){
+      this->runs.clear();
+      this->index.assign(m.begin(), m.end());
+      this->gather = SlothDispatchType(src_type, [](auto tag){ return &SlothRemap::GatherIndexed<decltype(tag)>; });
+    } else {
+      this->gather = SlothDispatchType(src_type, [](auto tag){ return &SlothRemap::GatherRuns<decltype(tag)>; });
+    }
+    return;
+  }
+
+  // Runs of consecutive source items with the same output are summed in registers before being added to the output.
+  for(size_t i = 0; i < map_count; ++i){
+    if(!this->runs.empty() && (size_t)m[i] == this->runs.back().dest){
+      ++this->runs.back().len;
+    } else {
+      this->runs.push_back({ i, (size_t)m[i], 1 });
+    }
+  }
+  if(this->op == Op::MeanBy){
+    std::vector<size_t> counts(dest_count, 0);
+    for(size_t i = 0; i < map_count; ++i)
+      ++counts[m[i]];
+    this->inv_counts.resize(dest_count);
+    for(size_t j = 0; j < dest_count; ++j)
+      this->inv_counts[j] = counts[j] == 0 ? 0.0 : 1.0 / counts[j];
+  }
+  this->x.resize(src_count);
+  this->acc.resize(dest_count);
+  this->load = SlothDispatchType(src_type, [](auto tag){ return &SlothLoadAsDouble<decltype(tag)>; });
+  this->store = SlothDispatchType(dest_type, [](auto tag){ return &SlothStoreFromDouble<decltype(tag)>; });
+}
+
+template<typename T>
+void SlothRemap::GatherRuns(const SlothRemap& plan, const void* src, void* dest){
+  const T* SLOTH_RESTRICT s = static_cast<const T*>(src);
+  T* SLOTH_RESTRICT d = static_cast<T*>(dest);
+  for(const Run& run : plan.runs){
+    if(run.len == 1)
+      d[run.dest] = s[run.src];
+    else
+      std::memcpy(d + run.dest, s + run.src, run.len * sizeof(T));
+  }
+}
+
+template<typename T>
+void SlothRemap::GatherIndexed(const SlothRemap& plan, const void* src, void* dest){
+  const T* SLOTH_RESTRICT s = static_cast<const T*>(src);
+  T* SLOTH_RESTRICT d = static_cast<T*>(dest);
+  const size_t* SLOTH_RESTRICT idx = plan.index.data();
+  const size_t n = plan.dest_count;
+  for(size_t j = 0; j < n; ++j)
+    d[j] = s[idx[j]];
+}
+
+void SlothRemap::Update(const void* src, void* dest){
+  if(this->op == Op::Gather){
+    this->gather(*this, src, dest);
+    return;
+  }
+
+  this->load(src, this->x.data(), this->src_count);
+  std::fill(this->acc.begin(), this->acc.end(), 0.0);
+  const double* SLOTH_RESTRICT xs = this->x.data();
+  double* SLOTH_RESTRICT a = this->acc.data();
+  for(const Run& run : this->runs){
+    double t = 0.0;
+    const double* SLOTH_RESTRICT rx = xs + run.src;
+    for(size_t k = 0; k < run.len; ++k)
+      t += rx[k];
+    a[run.dest] += t;
+  }
+  if(this->op == Op::MeanBy){
+    const double* SLOTH_RESTRICT inv = this->inv_counts.data();
+    for(size_t j = 0; j < this->dest_count; ++j)
+      a[j] *= inv[j];
+  }
+  this->store(a, dest, this->dest_count);
+}
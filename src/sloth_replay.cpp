@@ -0,0 +1,98 @@
+/**
+ * sloth_replay: Replays a trace recorded with `Sloth::StartTrace()` (or `trace_file=` in the config) against a fresh
+ * SLoTH instance as fast as possible, and reports per-call-type latency histograms.
+ *
+ * Usage: sloth_replay <trace_file> [repetitions]
+ *
+ * Values are not recorded in traces, so set calls are replayed from a scratch buffer of the recorded size. Calls
+ * which threw when they were recorded will generally throw again; these are counted as errors and excluded from the
+ * latency statistics.
+ *
+ * Config file settings recorded in the trace are applied to the replayed instance, as described for
+ * `SlothReplayTrace()`.
+ */
+#include "sloth.hpp"
+#include "sloth_replayer.hpp"
+#include "sloth_trace.hpp"
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <string>
+#include <vector>
+
+namespace {
+  std::string FormatNs(uint64_t ns){
+    char buf[32];
+    if(ns < 10000)
+      std::snprintf(buf, sizeof(buf), "%lluns", (unsigned long long)ns);
+    else if(ns < 10000000)
+      std::snprintf(buf, sizeof(buf), "%.1fus", ns / 1e3);
+    else
+      std::snprintf(buf, sizeof(buf), "%.1fms", ns / 1e6);
+    return buf;
+  }
+}
+
+int main(int argc, char** argv){
+  if(argc < 2 || argc > 3){
+    std::fprintf(stderr, "Usage: %s <trace_file> [repetitions]\n", argv[0]);
+    return 2;
+  }
+  int repetitions = argc == 3 ? std::atoi(argv[2]) : 1;
+  if(repetitions < 1){
+    std::fprintf(stderr, "Invalid repetitions \"%s\"\n", argv[2]);
+    return 2;
+  }
+
+  std::vector<SlothReplayStats> stats;
+  try {
+    for(int r = 0; r < repetitions; ++r){
+      // Each repetition gets a fresh instance, as the trace starts from one.
+      Sloth s;
+      SlothReplayTrace(s, argv[1], stats);
+    }
+  } catch(const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+
+  uint64_t total_calls = 0, total_ns = 0;
+  for(const SlothReplayStats& cs : stats){
+    total_calls += cs.count;
+    total_ns += cs.total_ns;
+  }
+  std::printf("Replayed %llu calls (%d repetition%s) in %s\n\n", (unsigned long long)total_calls, repetitions,
+              repetitions == 1 ? "" : "s", FormatNs(total_ns).c_str());
+  std::printf("%-20s %10s %8s %10s %10s %10s %10s %10s\n", "call", "count", "errors", "mean", "p50", "p90", "p99", "max");
+  for(size_t c = 1; c < stats.size(); ++c){
+    const SlothReplayStats& cs = stats[c];
+    if(cs.count == 0 && cs.errors == 0)
+      continue;
+    std::printf("%-20s %10llu %8llu %10s %10s %10s %10s %10s\n", SlothTraceCallName(static_cast<SlothTraceCall>(c)),
+                (unsigned long long)cs.count, (unsigned long long)cs.errors,
+                FormatNs(cs.count ? cs.total_ns / cs.count : 0).c_str(), FormatNs(cs.Quantile(0.5)).c_str(),
+                FormatNs(cs.Quantile(0.9)).c_str(), FormatNs(cs.Quantile(0.99)).c_str(), FormatNs(cs.max_ns).c_str());
+  }
+
+  std::printf("\nLatency histograms (upper bucket bound):\n");
+  for(size_t c = 1; c < stats.size(); ++c){
+    const SlothReplayStats& cs = stats[c];
+    if(cs.count == 0)
+      continue;
+    std::printf("%s\n", SlothTraceCallName(static_cast<SlothTraceCall>(c)));
+    uint64_t peak = 0;
+    for(int b = 0; b < SLOTH_REPLAY_BUCKETS; ++b)
+      if(cs.buckets[b] > peak)
+        peak = cs.buckets[b];
+    for(int b = 0; b < SLOTH_REPLAY_BUCKETS; ++b){
+      if(cs.buckets[b] == 0)
+        continue;
+      int width = (int)(40.0 * cs.buckets[b] / peak + 0.5);
+      std::printf("  <%10s |%-40s| %llu\n", FormatNs(b == 0 ? 1 : (uint64_t(1) << b)).c_str(),
+                  std::string(width > 0 ? width : 1, '#').c_str(), (unsigned long long)cs.buckets[b]);
+    }
+  }
+  return 0;
+}
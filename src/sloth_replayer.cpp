@@ -0,0 +1,133 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_replayer.hpp"
+#include "sloth_trace.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <exception>
+#include <fstream>
+#include <map>
+#include <stdexcept>
+
+namespace {
+  // Writes recorded settings as a config file, returning its path, or an empty string if there are none.
+  std::string WriteConfig(const std::map<std::string, std::string>& settings, const std::string& path){
+    if(settings.empty())
+      return "";
+    std::ofstream config(path);
+    for(auto const& iter: settings)
+      config << iter.first << "=" << iter.second << "\n";
+    if(!config){
+      throw std::runtime_error("Unable to write replay config file \"" + path + "\" " SOURCE_LOC);
+    }
+    return path;
+  }
+
+  // Removes the replay config file however the replay ends.
+  class RemoveOnExit {
+    public:
+      explicit RemoveOnExit(const std::string& path) : path(path) {}
+      ~RemoveOnExit(){ std::remove(this->path.c_str()); }
+    private:
+      std::string path;
+  };
+
+  void Replay(bmi::Bmi& model, SlothTraceRecord& rec, std::vector<char>& buffer, const std::string& config_path){
+    if(buffer.size() < rec.nbytes)
+      buffer.resize(rec.nbytes);
+    void* data = buffer.data();
+    switch(rec.call){
+      // Never re-read the recorded config itself (it may start a trace); use the settings recorded in the trace.
+      case SlothTraceCall::Initialize: model.Initialize(config_path); break;
+      case SlothTraceCall::Update: model.Update(); break;
+      case SlothTraceCall::UpdateUntil: model.UpdateUntil(rec.time); break;
+      case SlothTraceCall::Finalize: model.Finalize(); break;
+      case SlothTraceCall::GetValue: model.GetValue(rec.name, data); break;
+      case SlothTraceCall::GetValuePtr: model.GetValuePtr(rec.name); break;
+      case SlothTraceCall::GetValueAtIndices:
+        model.GetValueAtIndices(rec.name, data, rec.indices.data(), rec.indices.size());
+        break;
+      case SlothTraceCall::SetValue: model.SetValue(rec.name, data); break;
+      case SlothTraceCall::SetValueAtIndices:
+        model.SetValueAtIndices(rec.name, rec.indices.data(), rec.indices.size(), data);
+        break;
+      case SlothTraceCall::GetVarType: model.GetVarType(rec.name); break;
+      case SlothTraceCall::GetVarUnits: model.GetVarUnits(rec.name); break;
+      case SlothTraceCall::GetVarItemsize: model.GetVarItemsize(rec.name); break;
+      case SlothTraceCall::GetVarNbytes: model.GetVarNbytes(rec.name); break;
+      case SlothTraceCall::GetVarLocation: model.GetVarLocation(rec.name); break;
+      case SlothTraceCall::GetInputVarNames: model.GetInputVarNames(); break;
+      case SlothTraceCall::GetOutputVarNames: model.GetOutputVarNames(); break;
+      case SlothTraceCall::GetInputItemCount: model.GetInputItemCount(); break;
+      case SlothTraceCall::GetOutputItemCount: model.GetOutputItemCount(); break;
+      case SlothTraceCall::GetCurrentTime: model.GetCurrentTime(); break;
+      default: break;
+    }
+  }
+}
+
+void SlothReplayStats::Add(uint64_t ns){
+  int b = 0;
+  while(b < SLOTH_REPLAY_BUCKETS - 1 && (ns >> b) != 0)
+    ++b;
+  ++this->buckets[b];
+  ++this->count;
+  this->total_ns += ns;
+  if(ns > this->max_ns)
+    this->max_ns = ns;
+}
+
+uint64_t SlothReplayStats::Quantile(double q) const {
+  uint64_t target = (uint64_t)(q * this->count);
+  uint64_t seen = 0;
+  for(int b = 0; b < SLOTH_REPLAY_BUCKETS; ++b){
+    seen += this->buckets[b];
+    if(seen > target)
+      return b == 0 ? 0 : std::min(uint64_t(1) << b, this->max_ns);
+  }
+  return this->max_ns;
+}
+
+void SlothReplayTrace(bmi::Bmi& model, const std::string& trace_path, std::vector<SlothReplayStats>& stats){
+  if(stats.size() < static_cast<size_t>(SlothTraceCall::Count))
+    stats.resize(static_cast<size_t>(SlothTraceCall::Count));
+  std::string config_file = trace_path + ".replay.cfg";
+  RemoveOnExit remove_config(config_file);
+
+  SlothTraceReader reader(trace_path);
+  SlothTraceRecord rec;
+  std::vector<char> buffer;
+  std::map<std::string, std::string> settings;
+  std::string config_path;
+  bool pending = false;
+  while(reader.Next(rec)){
+    if(rec.call == SlothTraceCall::Config){
+      size_t eqpos = rec.name.find('=');
+      std::string key = rec.name.substr(0, eqpos);
+      std::string value = eqpos == std::string::npos ? "" : rec.name.substr(eqpos + 1);
+      settings[key] = key == "shm_name" ? value + "-replay" : value;
+      config_path = WriteConfig(settings, config_file);
+      pending = true;
+      continue;
+    }
+    if(pending && rec.call != SlothTraceCall::Initialize && !config_path.empty()){
+      // The trace started after Initialize(), so apply its settings now (untimed).
+      model.Initialize(config_path);
+    }
+    pending = false;
+
+    SlothReplayStats& cs = stats[static_cast<size_t>(rec.call)];
+    auto start = std::chrono::steady_clock::now();
+    try {
+      Replay(model, rec, buffer, config_path);
+    } catch(const std::exception&) {
+      ++cs.errors;
+      continue;
+    }
+    cs.Add(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+  }
+}
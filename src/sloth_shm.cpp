@@ -0,0 +1,233 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_shm.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+  uint64_t AlignUp(uint64_t v){
+    return (v + SLOTH_SHM_ALIGN - 1) / SLOTH_SHM_ALIGN * SLOTH_SHM_ALIGN;
+  }
+
+  void CopyField(char* dest, size_t size, const std::string& value, const char* what){
+    if(value.length() >= size){
+      throw std::runtime_error(std::string("Variable ") + what + " \"" + value + "\" is too long for shared memory (max "
+                               + std::to_string(size - 1) + " characters) " SOURCE_LOC);
+    }
+    std::memset(dest, 0, size);
+    std::memcpy(dest, value.data(), value.length());
+  }
+
+  std::string ReadField(const char* src, size_t size){
+    return std::string(src, strnlen(src, size));
+  }
+}
+
+#ifdef _WIN32
+
+SlothShmSegment::SlothShmSegment(const std::string& name, size_t capacity, size_t max_vars, bool replace){
+  throw std::runtime_error("Shared memory is not supported on this platform " SOURCE_LOC);
+}
+SlothShmSegment::~SlothShmSegment(){}
+void* SlothShmSegment::AddVariable(const std::string& name, const std::string& type, const std::string& units,
+                                   const std::string& location, uint64_t count, uint64_t itemsize, uint64_t nbytes){
+  throw std::runtime_error("Shared memory is not supported on this platform " SOURCE_LOC);
+}
+void SlothShmSegment::Publish(double time){}
+SlothShmReader::SlothShmReader(const std::string& name){
+  throw std::runtime_error("Shared memory is not supported on this platform " SOURCE_LOC);
+}
+SlothShmReader::~SlothShmReader(){}
+
+#else
+
+SlothShmSegment::SlothShmSegment(const std::string& name, size_t capacity, size_t max_vars, bool replace)
+  : name(name), capacity(capacity) {
+  uint64_t table_offset = AlignUp(sizeof(SlothShmHeader));
+  uint64_t data_offset = AlignUp(table_offset + max_vars * sizeof(SlothShmVar));
+  if(max_vars < 1 || capacity < data_offset){
+    throw std::runtime_error("Shared memory segment of " + std::to_string(capacity) + " bytes is too small for "
+                             + std::to_string(max_vars) + " variables " SOURCE_LOC);
+  }
+
+  if(replace){
+    shm_unlink(name.c_str());
+  }
+  int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+  if(fd < 0 && errno == EEXIST){
+    throw std::runtime_error("Shared memory segment \"" + name + "\" already exists and may be in use by another instance; "
+                             "use a different name, or enable replacing it (shm_replace=true) if it is stale " SOURCE_LOC);
+  }
+  if(fd < 0){
+    throw std::runtime_error("Unable to create shared memory segment \"" + name + "\": " + std::strerror(errno) + " " SOURCE_LOC);
+  }
+  if(ftruncate(fd, capacity) != 0){
+    int err = errno;
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("Unable to size shared memory segment \"" + name + "\": " + std::strerror(err) + " " SOURCE_LOC);
+  }
+  void* p = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED){
+    int err = errno;
+    shm_unlink(name.c_str());
+    throw std::runtime_error("Unable to map shared memory segment \"" + name + "\": " + std::strerror(err) + " " SOURCE_LOC);
+  }
+
+  // New segments are zero-filled, so only the non-zero fields need setting.
+  this->base = static_cast<char*>(p);
+  this->header = new (this->base) SlothShmHeader();
+  std::memcpy(this->header->magic, SLOTH_SHM_MAGIC, sizeof(this->header->magic));
+  this->header->version = SLOTH_SHM_VERSION;
+  this->header->header_size = sizeof(SlothShmHeader);
+  this->header->capacity = capacity;
+  this->header->table_offset = table_offset;
+  this->header->max_vars = max_vars;
+  this->header->var_count = 0;
+  this->header->data_offset = data_offset;
+  this->header->data_used = 0;
+  this->header->current_time = 0.0;
+  this->header->sequence.store(0, std::memory_order_release);
+}
+
+SlothShmSegment::~SlothShmSegment(){
+  munmap(this->base, this->capacity);
+  shm_unlink(this->name.c_str());
+}
+
+void* SlothShmSegment::AddVariable(const std::string& name, const std::string& type, const std::string& units,
+                                   const std::string& location, uint64_t count, uint64_t itemsize, uint64_t nbytes){
+  if(this->header->var_count >= this->header->max_vars){
+    throw std::runtime_error("Shared memory segment \"" + this->name + "\" has no room for variable \"" + name + "\" (max "
+                             + std::to_string(this->header->max_vars) + " variables) " SOURCE_LOC);
+  }
+  uint64_t offset = this->header->data_offset + this->header->data_used;
+  if(nbytes > this->capacity || offset + nbytes > this->capacity){
+    throw std::runtime_error("Shared memory segment \"" + this->name + "\" has no room for the " + std::to_string(nbytes)
+                             + " bytes of variable \"" + name + "\" " SOURCE_LOC);
+  }
+
+  this->BeginWrite();
+  SlothShmVar* var = reinterpret_cast<SlothShmVar*>(this->base + this->header->table_offset) + this->header->var_count;
+  CopyField(var->name, sizeof(var->name), name, "name");
+  CopyField(var->type, sizeof(var->type), type, "type");
+  CopyField(var->units, sizeof(var->units), units, "units");
+  CopyField(var->location, sizeof(var->location), location, "location");
+  var->count = count;
+  var->itemsize = itemsize;
+  var->nbytes = nbytes;
+  var->offset = offset;
+  this->header->data_used = AlignUp(this->header->data_used + nbytes);
+  ++this->header->var_count;
+  return this->base + offset;
+}
+
+void SlothShmSegment::Publish(double time){
+  this->BeginWrite();
+  this->header->current_time = time;
+  this->header->sequence.store(this->header->sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+  this->writing = false;
+}
+
+SlothShmReader::SlothShmReader(const std::string& name){
+  int fd = shm_open(name.c_str(), O_RDONLY, 0);
+  if(fd < 0){
+    throw std::runtime_error("Unable to open shared memory segment \"" + name + "\": " + std::strerror(errno) + " " SOURCE_LOC);
+  }
+  struct stat st;
+  if(fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(SlothShmHeader)){
+    close(fd);
+    throw std::runtime_error("Shared memory segment \"" + name + "\" is not a SLoTH segment " SOURCE_LOC);
+  }
+  void* p = mmap(nullptr, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if(p == MAP_FAILED){
+    throw std::runtime_error("Unable to map shared memory segment \"" + name + "\": " + std::strerror(errno) + " " SOURCE_LOC);
+  }
+  this->size = st.st_size;
+  this->base = static_cast<const char*>(p);
+  this->header = reinterpret_cast<const SlothShmHeader*>(this->base);
+  if(std::memcmp(this->header->magic, SLOTH_SHM_MAGIC, sizeof(this->header->magic)) != 0
+     || this->header->version != SLOTH_SHM_VERSION || this->header->capacity != this->size
+     || this->header->table_offset + (uint64_t)this->header->max_vars * sizeof(SlothShmVar) > this->size){
+    munmap(const_cast<char*>(this->base), this->size);
+    throw std::runtime_error("Shared memory segment \"" + name + "\" is not a compatible SLoTH segment " SOURCE_LOC);
+  }
+}
+
+SlothShmReader::~SlothShmReader(){
+  munmap(const_cast<char*>(this->base), this->size);
+}
+
+#endif
+
+uint64_t SlothShmReader::BeginRead(std::chrono::milliseconds timeout) const {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while(true){
+    uint64_t seq = this->header->sequence.load(std::memory_order_acquire);
+    if(seq % 2 == 0 || std::chrono::steady_clock::now() >= deadline){
+      return seq;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+}
+
+bool SlothShmReader::EndRead(uint64_t sequence) const {
+  std::atomic_thread_fence(std::memory_order_acquire);
+  return this->header->sequence.load(std::memory_order_relaxed) == sequence;
+}
+
+std::vector<SlothShmVarInfo> SlothShmReader::Variables() const {
+  std::vector<SlothShmVarInfo> retval;
+  const SlothShmVar* table = reinterpret_cast<const SlothShmVar*>(this->base + this->header->table_offset);
+  uint32_t var_count = std::min(this->header->var_count, this->header->max_vars);
+  for(uint32_t i = 0; i < var_count; ++i){
+    const SlothShmVar& var = table[i];
+    if(var.offset > this->size || var.nbytes > this->size - var.offset){
+      break; // Torn read; the caller's EndRead() will fail
+    }
+    retval.push_back({ ReadField(var.name, sizeof(var.name)), ReadField(var.type, sizeof(var.type)),
+                       ReadField(var.units, sizeof(var.units)), ReadField(var.location, sizeof(var.location)),
+                       var.count, var.itemsize, var.nbytes, this->base + var.offset });
+  }
+  return retval;
+}
+
+uint64_t SlothShmReader::Snapshot(std::vector<SlothShmVarInfo>& vars, std::vector<std::vector<char>>& values,
+                                  double& time, std::chrono::milliseconds timeout) const {
+  auto deadline = std::chrono::steady_clock::now() + timeout;
+  while(true){
+    auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - std::chrono::steady_clock::now());
+    uint64_t seq = this->BeginRead(remaining.count() > 0 ? remaining : std::chrono::milliseconds(0));
+    if(seq % 2 != 0){
+      return seq;
+    }
+    vars = this->Variables();
+    values.resize(vars.size());
+    for(size_t i = 0; i < vars.size(); ++i){
+      const char* data = static_cast<const char*>(vars[i].data);
+      values[i].assign(data, data + vars[i].nbytes);
+    }
+    time = this->header->current_time;
+    if(this->EndRead(seq)){
+      for(size_t i = 0; i < vars.size(); ++i)
+        vars[i].data = values[i].data();
+      return seq;
+    }
+  }
+}
@@ -0,0 +1,90 @@
+/**
+ * sloth_shm_read: Prints the variables a SLoTH instance publishes through shared memory (see
+ * `Sloth::EnableSharedMemory()`), reading a consistent snapshot of the last completed time step.
+ *
+ * Usage: sloth_shm_read [-f] [-n max_values] <segment_name> [variable...]
+ *
+ *   -f  Follow: print again every time a new step is published (until interrupted)
+ *   -n  Print at most this many values per variable (default 10, 0 for all)
+ */
+#include "sloth_kernels.hpp"
+#include "sloth_shm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+  void PrintVariable(const SlothShmVarInfo& var, size_t max_values){
+    std::printf("%s (%llu x %s, %s, %s):", var.name.c_str(), (unsigned long long)var.count, var.type.c_str(),
+                var.units.c_str(), var.location.c_str());
+    size_t n = max_values == 0 ? var.count : std::min<size_t>(var.count, max_values);
+    SlothDispatchType(var.type, [&](auto tag){
+      using T = decltype(tag);
+      const T* values = static_cast<const T*>(var.data);
+      for(size_t i = 0; i < n; ++i)
+        std::printf(" %.10g", (double)values[i]);
+    });
+    std::printf("%s\n", n < var.count ? " ..." : "");
+  }
+}
+
+int main(int argc, char** argv){
+  bool follow = false;
+  size_t max_values = 10;
+  int arg = 1;
+  for(; arg < argc && argv[arg][0] == '-'; ++arg){
+    if(std::strcmp(argv[arg], "-f") == 0){
+      follow = true;
+    } else if(std::strcmp(argv[arg], "-n") == 0 && arg + 1 < argc){
+      max_values = std::strtoull(argv[++arg], nullptr, 10);
+    } else {
+      break;
+    }
+  }
+  if(arg >= argc){
+    std::fprintf(stderr, "Usage: %s [-f] [-n max_values] <segment_name> [variable...]\n", argv[0]);
+    return 2;
+  }
+  std::string segment = argv[arg++];
+  std::vector<std::string> wanted(argv + arg, argv + argc);
+
+  try {
+    SlothShmReader reader(segment);
+    uint64_t last = 1; // Odd, so the first consistent snapshot is always printed
+    do {
+      std::vector<SlothShmVarInfo> vars;
+      std::vector<std::vector<char>> values;
+      double time;
+      uint64_t seq = reader.Snapshot(vars, values, time);
+      if(seq % 2 != 0){
+        if(!follow){
+          std::fprintf(stderr, "Timed out waiting for a consistent step in \"%s\"\n", segment.c_str());
+          return 1;
+        }
+        continue;
+      }
+      if(seq != last){
+        std::printf("step %llu, time %.10g\n", (unsigned long long)reader.PublishedSteps(seq), time);
+        for(const SlothShmVarInfo& var : vars){
+          if(wanted.empty() || std::find(wanted.begin(), wanted.end(), var.name) != wanted.end())
+            PrintVariable(var, max_values);
+        }
+        std::fflush(stdout);
+        last = seq;
+      }
+      if(follow)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    } while(follow);
+  } catch(const std::exception& e) {
+    std::fprintf(stderr, "%s\n", e.what());
+    return 1;
+  }
+  return 0;
+}
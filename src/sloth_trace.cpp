@@ -0,0 +1,254 @@
+#define STRINGIFY(x) #x
+#define TOSTRING(x) STRINGIFY(x)
+#define SOURCE_LOC " (" __FILE__ ":" TOSTRING(__LINE__) ")"
+
+#include "sloth_trace.hpp"
+
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+const char* SlothTraceCallName(SlothTraceCall call){
+  switch(call){
+    case SlothTraceCall::NameDef: return "NameDef";
+    case SlothTraceCall::Initialize: return "Initialize";
+    case SlothTraceCall::Update: return "Update";
+    case SlothTraceCall::UpdateUntil: return "UpdateUntil";
+    case SlothTraceCall::Finalize: return "Finalize";
+    case SlothTraceCall::GetValue: return "GetValue";
+    case SlothTraceCall::GetValuePtr: return "GetValuePtr";
+    case SlothTraceCall::GetValueAtIndices: return "GetValueAtIndices";
+    case SlothTraceCall::SetValue: return "SetValue";
+    case SlothTraceCall::SetValueAtIndices: return "SetValueAtIndices";
+    case SlothTraceCall::GetVarType: return "GetVarType";
+    case SlothTraceCall::GetVarUnits: return "GetVarUnits";
+    case SlothTraceCall::GetVarItemsize: return "GetVarItemsize";
+    case SlothTraceCall::GetVarNbytes: return "GetVarNbytes";
+    case SlothTraceCall::GetVarLocation: return "GetVarLocation";
+    case SlothTraceCall::GetInputVarNames: return "GetInputVarNames";
+    case SlothTraceCall::GetOutputVarNames: return "GetOutputVarNames";
+    case SlothTraceCall::GetInputItemCount: return "GetInputItemCount";
+    case SlothTraceCall::GetOutputItemCount: return "GetOutputItemCount";
+    case SlothTraceCall::GetCurrentTime: return "GetCurrentTime";
+    case SlothTraceCall::Config: return "Config";
+    default: return "Unknown";
+  }
+}
+
+SlothTraceRecorder::SlothTraceRecorder(const std::string& path, size_t buffer_bytes)
+  : epoch(std::chrono::steady_clock::now()), buffer_bytes(buffer_bytes) {
+  static std::atomic<uint64_t> next_id(1);
+  this->id = next_id++;
+  this->file = std::fopen(path.c_str(), "wb");
+  if(this->file == nullptr){
+    throw std::runtime_error("Unable to open trace file \"" + path + "\" for writing " SOURCE_LOC);
+  }
+  char magic[8] = SLOTH_TRACE_MAGIC;
+  uint32_t version = SLOTH_TRACE_VERSION, reserved = 0;
+  std::fwrite(magic, 1, sizeof(magic), this->file);
+  std::fwrite(&version, sizeof(version), 1, this->file);
+  std::fwrite(&reserved, sizeof(reserved), 1, this->file);
+
+  this->active.reserve(buffer_bytes);
+  this->pending.reserve(buffer_bytes);
+  this->writer = std::thread(&SlothTraceRecorder::WriterLoop, this);
+}
+
+SlothTraceRecorder::~SlothTraceRecorder(){
+  this->HandOff();
+  {
+    std::lock_guard<std::mutex> lock(this->mutex);
+    this->stopping = true;
+  }
+  this->cv.notify_all();
+  this->writer.join();
+  std::fclose(this->file);
+}
+
+void SlothTraceRecorder::Record(SlothTraceCall call, const std::string& name, uint64_t start_ns, uint64_t duration_ns,
+                                uint64_t nbytes, const int* inds, int count, double time) noexcept {
+  size_t size_before = this->active.size();
+  bool new_name = false;
+  try {
+    uint32_t id = std::numeric_limits<uint32_t>::max();
+    if(!name.empty()){
+      new_name = this->name_ids.count(name) == 0;
+      id = this->NameId(name);
+    }
+    this->Put(static_cast<uint8_t>(call));
+    this->Put(id);
+    this->Put(start_ns);
+    this->Put(duration_ns);
+    this->Put(nbytes);
+    if(call == SlothTraceCall::GetValueAtIndices || call == SlothTraceCall::SetValueAtIndices){
+      int32_t n = (inds == nullptr || count < 0) ? 0 : count;
+      this->Put(n);
+      const char* p = reinterpret_cast<const char*>(inds);
+      this->active.insert(this->active.end(), p, p + sizeof(int32_t) * n);
+    } else if(call == SlothTraceCall::UpdateUntil){
+      this->Put(time);
+    }
+  } catch(...) {
+    // Roll back the partial record (and its name definition, if it was buffered in the same call) so the trace
+    // stays decodable. Shrinking never reallocates, so this cannot throw.
+    this->active.resize(size_before);
+    if(new_name)
+      this->name_ids.erase(name);
+    this->record_error = true;
+    return;
+  }
+  if(this->active.size() >= this->buffer_bytes){
+    try {
+      this->HandOff();
+    } catch(...) {
+      this->active.clear();
+      this->record_error = true;
+    }
+  }
+}
+
+void SlothTraceRecorder::Flush(){
+  this->HandOff();
+  std::unique_lock<std::mutex> lock(this->mutex);
+  this->cv.wait(lock, [this]{ return this->pending.empty() || this->write_error; });
+  if(this->write_error || std::fflush(this->file) != 0){
+    throw std::runtime_error("Failed writing to trace file " SOURCE_LOC);
+  }
+  if(this->record_error){
+    throw std::runtime_error("Some calls could not be recorded in the trace file " SOURCE_LOC);
+  }
+}
+
+uint32_t SlothTraceRecorder::NameId(const std::string& name){
+  auto iter = this->name_ids.find(name);
+  if(iter != this->name_ids.end()){
+    return iter->second;
+  }
+  uint32_t id = this->name_ids.size();
+  this->name_ids.emplace(name, id);
+  uint32_t len = name.size();
+  this->Put(static_cast<uint8_t>(SlothTraceCall::NameDef));
+  this->Put(id);
+  this->Put(len);
+  this->active.insert(this->active.end(), name.begin(), name.end());
+  return id;
+}
+
+void SlothTraceRecorder::HandOff(){
+  if(this->active.empty()){
+    return;
+  }
+  {
+    // Only blocks if the writer has fallen a whole buffer behind.
+    std::unique_lock<std::mutex> lock(this->mutex);
+    this->cv.wait(lock, [this]{ return this->pending.empty() || this->write_error; });
+    if(this->write_error){
+      // Nothing more can be written; drop the records rather than throw from a BMI call. Flush() will report it.
+      this->active.clear();
+      return;
+    }
+    this->pending.swap(this->active);
+  }
+  this->cv.notify_all();
+}
+
+void SlothTraceRecorder::WriterLoop(){
+  std::vector<char> writing;
+  writing.reserve(this->buffer_bytes);
+  std::unique_lock<std::mutex> lock(this->mutex);
+  while(true){
+    this->cv.wait(lock, [this]{ return !this->pending.empty() || this->stopping; });
+    if(this->pending.empty()){
+      return; // stopping, and nothing left to write
+    }
+    writing.swap(this->pending);
+    lock.unlock();
+    bool ok = std::fwrite(writing.data(), 1, writing.size(), this->file) == writing.size();
+    writing.clear();
+    lock.lock();
+    this->write_error = this->write_error || !ok;
+    this->cv.notify_all();
+  }
+}
+
+SlothTraceReader::SlothTraceReader(const std::string& path){
+  this->file = std::fopen(path.c_str(), "rb");
+  if(this->file == nullptr){
+    throw std::runtime_error("Unable to open trace file \"" + path + "\" for reading " SOURCE_LOC);
+  }
+  char magic[8];
+  uint32_t version, reserved;
+  if(std::fread(magic, 1, sizeof(magic), this->file) != sizeof(magic) || std::memcmp(magic, SLOTH_TRACE_MAGIC, sizeof(magic)) != 0
+     || !this->Get(version) || !this->Get(reserved)){
+    std::fclose(this->file);
+    throw std::runtime_error("File \"" + path + "\" is not a SLoTH trace " SOURCE_LOC);
+  }
+  if(version < 1 || version > SLOTH_TRACE_VERSION){
+    std::fclose(this->file);
+    throw std::runtime_error("Unsupported SLoTH trace version " + std::to_string(version) + " in \"" + path + "\" " SOURCE_LOC);
+  }
+}
+
+SlothTraceReader::~SlothTraceReader(){
+  std::fclose(this->file);
+}
+
+template<typename T>
+bool SlothTraceReader::Get(T& v){
+  return std::fread(&v, sizeof(T), 1, this->file) == 1;
+}
+
+bool SlothTraceReader::Next(SlothTraceRecord& rec){
+  uint8_t call;
+  while(this->Get(call)){
+    uint32_t id;
+    if(!this->Get(id)){
+      throw std::runtime_error("Truncated SLoTH trace " SOURCE_LOC);
+    }
+    if(call == static_cast<uint8_t>(SlothTraceCall::NameDef)){
+      uint32_t len;
+      if(!this->Get(len) || id != this->names.size()){
+        throw std::runtime_error("Corrupt name definition in SLoTH trace " SOURCE_LOC);
+      }
+      std::string name(len, '\0');
+      if(len > 0 && std::fread(&name[0], 1, len, this->file) != len){
+        throw std::runtime_error("Truncated SLoTH trace " SOURCE_LOC);
+      }
+      this->names.push_back(std::move(name));
+      continue;
+    }
+    if(call >= static_cast<uint8_t>(SlothTraceCall::Count)){
+      throw std::runtime_error("Unknown call type " + std::to_string(call) + " in SLoTH trace " SOURCE_LOC);
+    }
+
+    rec.call = static_cast<SlothTraceCall>(call);
+    if(id == std::numeric_limits<uint32_t>::max()){
+      rec.name.clear();
+    } else if(id < this->names.size()){
+      rec.name = this->names[id];
+    } else {
+      throw std::runtime_error("Undefined name id in SLoTH trace " SOURCE_LOC);
+    }
+    if(!this->Get(rec.start_ns) || !this->Get(rec.duration_ns) || !this->Get(rec.nbytes)){
+      throw std::runtime_error("Truncated SLoTH trace " SOURCE_LOC);
+    }
+    rec.indices.clear();
+    rec.time = 0.0;
+    if(rec.call == SlothTraceCall::GetValueAtIndices || rec.call == SlothTraceCall::SetValueAtIndices){
+      int32_t n;
+      if(!this->Get(n) || n < 0){
+        throw std::runtime_error("Truncated SLoTH trace " SOURCE_LOC);
+      }
+      rec.indices.resize(n);
+      if(n > 0 && std::fread(rec.indices.data(), sizeof(int32_t), n, this->file) != (size_t)n){
+        throw std::runtime_error("Truncated SLoTH trace " SOURCE_LOC);
+      }
+    } else if(rec.call == SlothTraceCall::UpdateUntil){
+      if(!this->Get(rec.time)){
+        throw std::runtime_error("Truncated SLoTH trace " SOURCE_LOC);
+      }
+    }
+    return true;
+  }
+  return false;
+}
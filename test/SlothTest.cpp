@@ -1,7 +1,16 @@
 #include "gtest/gtest.h"
 
 #include <sloth.hpp>
+#include <sloth_replayer.hpp>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
 #include <string>
+#include <vector>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
 
 class Sloth_Test {
 
@@ -183,3 +192,698 @@ TEST(Sloth_Test, TestSlothGetVarTypeAddsVariable)
 }
 
 
+
+TEST(Sloth_Test, TestSlothTraceRecordsOutermostCalls)
+{
+  std::string path = testing::TempDir() + "sloth_test_trace.trc";
+  auto s = Sloth();
+  s.StartTrace(path);
+
+  double v[] = { 42.0, 43.0, 44.0 };
+  s.SetValue("somedoubles(3,double,K,node,alias)", v);
+  s.SetValue("alias", v); // Punted to `somedoubles` internally, but only the outer call should be recorded
+  int inds[2] = { 2, 0 };
+  s.GetValueAtIndices("somedoubles", v, inds, 2);
+  s.UpdateUntil(3600.0);
+  s.GetVarUnits("alias");
+  s.StopTrace();
+
+  SlothTraceReader reader(path);
+  SlothTraceRecord rec;
+  std::vector<SlothTraceRecord> recs;
+  while(reader.Next(rec))
+    recs.push_back(rec);
+
+  ASSERT_EQ( recs.size(), 5 );
+  ASSERT_EQ( recs[0].call, SlothTraceCall::SetValue );
+  ASSERT_STREQ( recs[0].name.c_str(), "somedoubles(3,double,K,node,alias)" );
+  ASSERT_EQ( recs[0].nbytes, sizeof(double) * 3 );
+  ASSERT_EQ( recs[1].call, SlothTraceCall::SetValue );
+  ASSERT_STREQ( recs[1].name.c_str(), "alias" );
+  ASSERT_EQ( recs[1].nbytes, sizeof(double) * 3 );
+  ASSERT_EQ( recs[2].call, SlothTraceCall::GetValueAtIndices );
+  ASSERT_EQ( recs[2].nbytes, sizeof(double) * 2 );
+  ASSERT_EQ( recs[2].indices, std::vector<int>({ 2, 0 }) );
+  ASSERT_EQ( recs[3].call, SlothTraceCall::UpdateUntil );
+  ASSERT_EQ( recs[3].time, 3600.0 );
+  ASSERT_EQ( recs[4].call, SlothTraceCall::GetVarUnits );
+  ASSERT_LE( recs[0].start_ns, recs[4].start_ns );
+  std::remove(path.c_str());
+}
+
+TEST(Sloth_Test, TestSlothTraceReplacedDuringInitialize)
+{
+  // Initialize() reading a config with trace_file replaces the running trace while Initialize itself is traced
+  std::string config_path = testing::TempDir() + "sloth_test_retrace.cfg";
+  std::string first_path = testing::TempDir() + "sloth_test_retrace_a.trc";
+  std::string second_path = testing::TempDir() + "sloth_test_retrace_b.trc";
+  FILE* config = std::fopen(config_path.c_str(), "w");
+  std::fprintf(config, "trace_file=%s\n", second_path.c_str());
+  std::fclose(config);
+
+  auto s = Sloth();
+  s.StartTrace(first_path);
+  s.Initialize(config_path);
+  s.Initialize(config_path); // Again, with the config's own trace running
+  double v = 1.0;
+  s.SetValue("adouble", &v);
+  s.StopTrace();
+
+  std::vector<SlothTraceRecord> first, second;
+  SlothTraceRecord rec;
+  SlothTraceReader reader_a(first_path);
+  while(reader_a.Next(rec))
+    first.push_back(rec);
+  SlothTraceReader reader_b(second_path);
+  while(reader_b.Next(rec))
+    second.push_back(rec);
+  ASSERT_EQ( first.size(), 0 );
+  ASSERT_EQ( second.size(), 1 );
+  ASSERT_EQ( second[0].call, SlothTraceCall::SetValue );
+
+  std::remove(config_path.c_str());
+  std::remove(first_path.c_str());
+  std::remove(second_path.c_str());
+}
+
+TEST(Sloth_Test, TestSlothTraceFileFromConfig)
+{
+  std::string config_path = testing::TempDir() + "sloth_test_trace.cfg";
+  std::string trace_path = testing::TempDir() + "sloth_test_config.trc";
+  FILE* config = std::fopen(config_path.c_str(), "w");
+  std::fprintf(config, "# SLoTH test config\n\ntrace_file = %s\nfilter.T2D = nodata=-9999\n", trace_path.c_str());
+  std::fclose(config);
+
+  auto s = Sloth();
+  s.Initialize(config_path);
+  double v = 42.0;
+  s.SetValue("adouble", &v);
+  s.Finalize();
+
+  SlothTraceReader reader(trace_path);
+  SlothTraceRecord rec;
+  // Settings other than trace_file are recorded for replays
+  ASSERT_TRUE( reader.Next(rec) );
+  ASSERT_EQ( rec.call, SlothTraceCall::Config );
+  ASSERT_STREQ( rec.name.c_str(), "filter.T2D=nodata=-9999" );
+  ASSERT_TRUE( reader.Next(rec) );
+  ASSERT_EQ( rec.call, SlothTraceCall::SetValue );
+  ASSERT_STREQ( rec.name.c_str(), "adouble" );
+  ASSERT_TRUE( reader.Next(rec) );
+  ASSERT_EQ( rec.call, SlothTraceCall::Finalize );
+  ASSERT_FALSE( reader.Next(rec) );
+
+  auto s2 = Sloth();
+  config = std::fopen(config_path.c_str(), "w");
+  std::fprintf(config, "not_a_setting=1\n");
+  std::fclose(config);
+  ASSERT_THROW( s2.Initialize(config_path), std::runtime_error );
+
+  std::remove(config_path.c_str());
+  std::remove(trace_path.c_str());
+}
+
+TEST(Sloth_Test, TestSlothReplayAppliesRecordedConfig)
+{
+  // Replayed set calls use a zeroed buffer, so a filter treating 0 as nodata shows whether the config was applied.
+  std::string config_path = testing::TempDir() + "sloth_test_replay.cfg";
+  std::string trace_path = testing::TempDir() + "sloth_test_replay.trc";
+  FILE* config = std::fopen(config_path.c_str(), "w");
+  std::fprintf(config, "filter.T2D=nodata=0:fill=7\n");
+  std::fclose(config);
+
+  auto s = Sloth();
+  s.StartTrace(trace_path);
+  s.Initialize(config_path); // Traced, so replayed with the recorded settings
+  double v[2] = { 1.0, 2.0 };
+  s.SetValue("temp(2,double,K,node,T2D)", v);
+  s.SetValue("T2D", v);
+  s.UpdateUntil(3600.0);
+  s.GetValue("temp", v);
+  s.GetValue("temp", v);
+  s.Finalize();
+  std::remove(config_path.c_str()); // The replay must not depend on the original config
+
+  auto r = Sloth();
+  std::vector<SlothReplayStats> stats;
+  SlothReplayTrace(r, trace_path, stats);
+  double out[2];
+  r.GetValue("temp", out);
+  ASSERT_EQ( out[0], 7.0 );
+  ASSERT_EQ( out[1], 7.0 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::Initialize].count, 1 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::SetValue].count, 2 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::UpdateUntil].count, 1 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::GetValue].count, 2 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::Finalize].count, 1 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::Config].count, 0 ); // Not calls
+  for(const SlothReplayStats& cs : stats)
+    ASSERT_EQ( cs.errors, 0 );
+  ASSERT_EQ( std::fopen((trace_path + ".replay.cfg").c_str(), "r"), nullptr ); // Cleaned up
+
+  // Without the recorded settings, the zeros pass through unfiltered
+  auto plain = Sloth();
+  plain.StartTrace(trace_path);
+  plain.SetValue("temp(2,double,K,node,T2D)", v);
+  plain.SetValue("T2D", v);
+  plain.StopTrace();
+  auto r2 = Sloth();
+  SlothReplayTrace(r2, trace_path, stats);
+  r2.GetValue("temp", out);
+  ASSERT_EQ( out[0], 0.0 );
+  std::remove(trace_path.c_str());
+}
+
+TEST(Sloth_Test, TestSlothRunningSumAndMean)
+{
+  auto s = Sloth();
+  double zero[2] = { 0.0, 0.0 };
+  s.SetValue("precip(2,double,mm,node,APCP)", zero);
+  s.SetValue("precip_total(2,double,mm,node,,sum:APCP)", zero);
+  s.SetValue("precip_mean3(2,double,mm,node,,mean:precip:window=3)", zero);
+  s.SetValue("precip_daily(2,double,mm,node,,sum:precip:reset=2)", zero);
+
+  double in[5][2] = { { 1.0, 10.0 }, { 2.0, 20.0 }, { 3.0, 30.0 }, { 4.0, 40.0 }, { 5.0, 50.0 } };
+  double total[2], mean3[2], daily[2];
+  for(int t = 0; t < 5; ++t){
+    s.SetValue("APCP", in[t]);
+    s.UpdateUntil(3600.0 * (t + 1));
+    s.GetValue("precip_total", total);
+    s.GetValue("precip_mean3", mean3);
+    s.GetValue("precip_daily", daily);
+  }
+  ASSERT_EQ( total[0], 15.0 );
+  ASSERT_EQ( total[1], 150.0 );
+  ASSERT_DOUBLE_EQ( mean3[0], 4.0 );
+  ASSERT_DOUBLE_EQ( mean3[1], 40.0 );
+  ASSERT_EQ( daily[0], 5.0 ); // Reset after steps 2 and 4
+  ASSERT_EQ( daily[1], 50.0 );
+  ASSERT_EQ( s.GetOutputItemCount(), 4 );
+  ASSERT_EQ( s.GetInputItemCount(), 1 );
+}
+
+TEST(Sloth_Test, TestSlothRunningSlidingExtremes)
+{
+  auto s = Sloth();
+  int zero = 0;
+  s.SetValue("temp(1,int,K)", &zero);
+  s.SetValue("temp_min4(1,int,K,node,,min:temp:window=4)", &zero);
+  double zero_double = 0.0;
+  s.SetValue("temp_max4(1,double,K,node,,max:temp:window=4)", &zero_double);
+  s.SetValue("temp_max(1,int,K,node,,max:temp)", &zero);
+
+  int in[] = { 5, 3, 8, 1, 9, 7, 2, 6, 4, 4, 10, 0, 3 };
+  int n = sizeof(in) / sizeof(in[0]);
+  for(int t = 0; t < n; ++t){
+    s.SetValue("temp", &in[t]);
+    s.UpdateUntil(t + 1);
+
+    int expected_min = in[t], expected_max = in[t];
+    for(int k = std::max(0, t - 3); k <= t; ++k){
+      expected_min = std::min(expected_min, in[k]);
+      expected_max = std::max(expected_max, in[k]);
+    }
+    int min4;
+    double max4;
+    s.GetValue("temp_min4", &min4);
+    s.GetValue("temp_max4", &max4);
+    ASSERT_EQ( min4, expected_min ) << "at step " << t;
+    ASSERT_EQ( max4, (double)expected_max ) << "at step " << t;
+  }
+  int max_all;
+  s.GetValue("temp_max", &max_all);
+  ASSERT_EQ( max_all, 10 );
+}
+
+TEST(Sloth_Test, TestSlothRunningEwma)
+{
+  auto s = Sloth();
+  double v = 0.0;
+  s.SetValue("x(1,double,1,node,xin)", &v);
+  s.SetValue("x_smooth(1,double,1,node,,ewma:xin:alpha=0.5)", &v);
+
+  double in[] = { 4.0, 8.0, 0.0 };
+  for(int t = 0; t < 3; ++t){
+    s.SetValue("xin", &in[t]);
+    s.UpdateUntil(t + 1);
+  }
+  s.GetValue("x_smooth", &v);
+  ASSERT_DOUBLE_EQ( v, 3.0 ); // 4, then 6, then 3
+
+  // Repeating the current time is not a new step
+  s.UpdateUntil(3);
+  s.GetValue("x_smooth", &v);
+  ASSERT_DOUBLE_EQ( v, 3.0 );
+}
+
+TEST(Sloth_Test, TestSlothRunningStatisticErrors)
+{
+  auto s = Sloth();
+  double v[2] = { 0.0, 0.0 };
+  ASSERT_THROW( s.SetValue("bad1(1,double,1,node,,median:x)", v), std::runtime_error );
+  ASSERT_THROW( s.SetValue("bad2(1,double,1,node,,sum)", v), std::runtime_error );
+  ASSERT_THROW( s.SetValue("bad3(1,double,1,node,alias,sum:x)", v), std::runtime_error );
+
+  s.SetValue("x(2)", v);
+  s.SetValue("wrongcount(1,double,1,node,,sum:x)", v);
+  ASSERT_THROW( s.UpdateUntil(1.0), std::runtime_error );
+
+  auto s2 = Sloth();
+  s2.SetValue("x(2)", v);
+  s2.SetValue("badalpha(2,double,1,node,,ewma:x:alpha=2)", v);
+  ASSERT_THROW( s2.UpdateUntil(1.0), std::runtime_error );
+
+  auto s3 = Sloth();
+  s3.SetValue("nosource(2,double,1,node,,max:missing:window=2)", v);
+  ASSERT_THROW( s3.UpdateUntil(1.0), std::runtime_error );
+}
+
+TEST(Sloth_Test, TestSlothGatherRemap)
+{
+  auto s = Sloth();
+  double q[6] = { 0.0, 1.0, 2.0, 3.0, 4.0, 5.0 };
+  s.SetValue("cat_q(6,double,m3 s-1,node,Q_OUT)", q);
+  int order[5] = { 2, 3, 4, 0, 0 };
+  s.SetValue("nexus_order(5,int)", order);
+  int scattered[4] = { 5, 1, 3, 0 };
+  s.SetValue("scattered_order(4,int)", scattered);
+  double init[5] = { 0.0, 0.0, 0.0, 0.0, 0.0 };
+  s.SetValue("nexus_q(5,double,m3 s-1,node,,gather:Q_OUT:map=nexus_order)", init);
+  s.SetValue("scattered_q(4,double,m3 s-1,node,,gather:cat_q:map=scattered_order)", init);
+
+  for(int t = 0; t < 2; ++t){
+    for(int i = 0; i < 6; ++i)
+      q[i] = 10.0 * t + i;
+    s.SetValue("Q_OUT", q);
+    s.UpdateUntil(t + 1);
+  }
+  double out[5];
+  s.GetValue("nexus_q", out);
+  ASSERT_EQ( out[0], 12.0 );
+  ASSERT_EQ( out[1], 13.0 );
+  ASSERT_EQ( out[2], 14.0 );
+  ASSERT_EQ( out[3], 10.0 );
+  ASSERT_EQ( out[4], 10.0 );
+  s.GetValue("scattered_q", out);
+  ASSERT_EQ( out[0], 15.0 );
+  ASSERT_EQ( out[1], 11.0 );
+  ASSERT_EQ( out[2], 13.0 );
+  ASSERT_EQ( out[3], 10.0 );
+
+  // A map with few, long runs is compiled to block copies
+  auto s2 = Sloth();
+  int v[8] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+  s2.SetValue("src(8,int)", v);
+  int rotate[8] = { 4, 5, 6, 7, 0, 1, 2, 3 };
+  s2.SetValue("rotate(8,int)", rotate);
+  s2.SetValue("rotated(8,int,1,node,,gather:src:map=rotate)", v);
+  s2.UpdateUntil(1.0);
+  s2.GetValue("rotated", v);
+  for(int i = 0; i < 8; ++i)
+    ASSERT_EQ( v[i], rotate[i] );
+}
+
+TEST(Sloth_Test, TestSlothReducingRemap)
+{
+  auto s = Sloth();
+  int q[5] = { 1, 2, 3, 4, 6 };
+  s.SetValue("cat_q(5,int)", q);
+  long to_nexus[5] = { 1, 1, 0, 1, 0 };
+  s.SetValue("to_nexus(5,long)", to_nexus);
+  double init[3] = { 0.0, 0.0, 0.0 };
+  s.SetValue("nexus_sum(3,double,1,node,,sum_by:cat_q:map=to_nexus)", init);
+  s.SetValue("nexus_mean(3,double,1,node,,mean_by:cat_q:map=to_nexus)", init);
+  s.UpdateUntil(1.0);
+
+  double out[3];
+  s.GetValue("nexus_sum", out);
+  ASSERT_EQ( out[0], 9.0 );
+  ASSERT_EQ( out[1], 7.0 );
+  ASSERT_EQ( out[2], 0.0 );
+  s.GetValue("nexus_mean", out);
+  ASSERT_DOUBLE_EQ( out[0], 4.5 );
+  ASSERT_DOUBLE_EQ( out[1], 7.0 / 3.0 );
+  ASSERT_EQ( out[2], 0.0 );
+}
+
+TEST(Sloth_Test, TestSlothRemapErrors)
+{
+  double v[3] = { 0.0, 0.0, 0.0 };
+  int bad_map[3] = { 0, 1, 3 };
+
+  auto s = Sloth();
+  s.SetValue("x(3)", v);
+  s.SetValue("bad_map(3,int)", bad_map);
+  s.SetValue("y(3,double,1,node,,gather:x:map=bad_map)", v);
+  ASSERT_THROW( s.UpdateUntil(1.0), std::runtime_error ); // Index 3 out of range
+
+  auto s2 = Sloth();
+  s2.SetValue("x(3)", v);
+  s2.SetValue("float_map(3,double)", v);
+  s2.SetValue("y(3,double,1,node,,gather:x:map=float_map)", v);
+  ASSERT_THROW( s2.UpdateUntil(1.0), std::runtime_error );
+
+  auto s3 = Sloth();
+  s3.SetValue("x(3)", v);
+  s3.SetValue("y(3,double,1,node,,sum_by:x)", v);
+  ASSERT_THROW( s3.UpdateUntil(1.0), std::runtime_error ); // No map
+}
+
+#ifndef _WIN32
+TEST(Sloth_Test, TestSlothSharedMemoryPublishesSteps)
+{
+  std::string segment = "/sloth_test_" + std::to_string(::getpid());
+  auto s = Sloth();
+  s.EnableSharedMemory(segment, 1 << 16, 8);
+  double v[3] = { 1.0, 2.0, 3.0 };
+  s.SetValue("somedoubles(3,double,K,node,T2D)", v);
+  int n = 7;
+  s.SetValue("anint(1,int,1,edge)", &n);
+
+  SlothShmReader reader(segment);
+  // Not yet published: values are being defined
+  ASSERT_EQ( reader.BeginRead(std::chrono::milliseconds(0)) % 2, 1 );
+
+  s.UpdateUntil(3600.0);
+  uint64_t seq = reader.BeginRead();
+  ASSERT_EQ( seq % 2, 0 );
+  ASSERT_EQ( reader.PublishedSteps(seq), 1 );
+  ASSERT_EQ( reader.CurrentTime(), 3600.0 );
+  std::vector<SlothShmVarInfo> vars = reader.Variables();
+  ASSERT_TRUE( reader.EndRead(seq) );
+  ASSERT_EQ( vars.size(), 2 );
+  ASSERT_STREQ( vars[0].name.c_str(), "somedoubles" );
+  ASSERT_STREQ( vars[0].units.c_str(), "K" );
+  ASSERT_EQ( vars[0].count, 3 );
+  ASSERT_EQ( vars[0].nbytes, sizeof(double) * 3 );
+  ASSERT_STREQ( vars[1].type.c_str(), "int" );
+  ASSERT_STREQ( vars[1].location.c_str(), "edge" );
+  // Zero copy: the reader sees the model's own storage
+  ASSERT_EQ( static_cast<const double*>(vars[0].data)[2], 3.0 );
+
+  v[2] = 30.0;
+  s.SetValue("T2D", v);
+  ASSERT_FALSE( reader.EndRead(seq) );
+  s.UpdateUntil(7200.0);
+
+  std::vector<std::vector<char>> values;
+  double time;
+  seq = reader.Snapshot(vars, values, time);
+  ASSERT_EQ( reader.PublishedSteps(seq), 2 );
+  ASSERT_EQ( time, 7200.0 );
+  ASSERT_EQ( static_cast<const double*>(vars[0].data)[2], 30.0 );
+  ASSERT_EQ( *static_cast<const int*>(vars[1].data), 7 );
+
+  auto s2 = Sloth();
+  s2.SetValue("adouble", v);
+  ASSERT_THROW( s2.EnableSharedMemory(segment + "_late"), std::runtime_error );
+}
+
+TEST(Sloth_Test, TestSlothSharedMemoryExistingSegment)
+{
+  std::string segment = "/sloth_test_existing_" + std::to_string(::getpid());
+  auto s = Sloth();
+  s.EnableSharedMemory(segment, 1 << 16, 8);
+  double v = 1.0;
+  s.SetValue("adouble", &v);
+  s.UpdateUntil(1.0);
+
+  // A second instance must not silently take over a live segment
+  auto s2 = Sloth();
+  ASSERT_THROW( s2.EnableSharedMemory(segment, 1 << 16, 8), std::runtime_error );
+  SlothShmReader reader(segment);
+  std::vector<SlothShmVarInfo> vars;
+  std::vector<std::vector<char>> values;
+  double time;
+  ASSERT_EQ( reader.PublishedSteps(reader.Snapshot(vars, values, time)), 1 );
+  ASSERT_EQ( vars.size(), 1 );
+
+  // ...unless asked to replace a stale one
+  auto s3 = Sloth();
+  s3.EnableSharedMemory(segment, 1 << 16, 8, true);
+  s3.SetValue("other", &v);
+  s3.UpdateUntil(1.0);
+  SlothShmReader reader3(segment);
+  reader3.Snapshot(vars, values, time);
+  ASSERT_EQ( vars.size(), 1 );
+  ASSERT_STREQ( vars[0].name.c_str(), "other" );
+}
+
+TEST(Sloth_Test, TestSlothSharedMemoryFullLeavesNothingBehind)
+{
+  std::string segment = "/sloth_test_full_" + std::to_string(::getpid());
+  auto s = Sloth();
+  s.EnableSharedMemory(segment, 1 << 16, 8);
+  std::vector<double> big(100000, 1.0);
+  ASSERT_THROW( s.SetValue("big(100000,double,m,node,BIG_IN)", big.data()), std::runtime_error );
+  ASSERT_EQ( s.GetOutputItemCount(), 0 );
+  ASSERT_EQ( s.GetInputItemCount(), 0 );
+
+  // The name is free to be defined again, at a size that fits
+  s.SetValue("big(100,double,m,node,BIG_IN)", big.data());
+  ASSERT_EQ( s.GetVarNbytes("big"), 800 );
+  ASSERT_EQ( s.GetVarUnits("big"), "m" );
+  big[99] = 5.0;
+  s.SetValue("BIG_IN", big.data());
+  double out[100];
+  s.GetValue("big", out);
+  ASSERT_EQ( out[99], 5.0 );
+  ASSERT_EQ( s.GetOutputItemCount(), 1 );
+}
+
+TEST(Sloth_Test, TestSlothReplayAfterInitializeRenamesSegment)
+{
+  std::string config_path = testing::TempDir() + "sloth_test_replay_shm.cfg";
+  std::string trace_path = testing::TempDir() + "sloth_test_replay_shm.trc";
+  std::string segment = "/sloth_test_replay_" + std::to_string(::getpid());
+  FILE* config = std::fopen(config_path.c_str(), "w");
+  std::fprintf(config, "shm_name=%s\nshm_size=65536\nshm_max_vars=8\nfilter.T2D=nodata=0:fill=7\n", segment.c_str());
+  std::fclose(config);
+
+  auto s = Sloth();
+  s.Initialize(config_path);
+  s.StartTrace(trace_path); // After Initialize(), so the settings are recorded at the start of the trace
+  double v[2] = { 1.0, 2.0 };
+  s.SetValue("temp(2,double,K,node,T2D)", v);
+  s.SetValue("T2D", v);
+  s.UpdateUntil(3600.0);
+  s.StopTrace();
+
+  // Replayed while the original instance (and its segment) is still alive
+  auto r = Sloth();
+  std::vector<SlothReplayStats> stats;
+  SlothReplayTrace(r, trace_path, stats);
+  for(const SlothReplayStats& cs : stats)
+    ASSERT_EQ( cs.errors, 0 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::Initialize].count, 0 ); // Applied untimed, not as a replayed call
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::SetValue].count, 2 );
+  ASSERT_EQ( stats[(size_t)SlothTraceCall::UpdateUntil].count, 1 );
+
+  SlothShmReader reader(segment + "-replay");
+  std::vector<SlothShmVarInfo> vars;
+  std::vector<std::vector<char>> values;
+  double time;
+  ASSERT_EQ( reader.PublishedSteps(reader.Snapshot(vars, values, time)), 1 );
+  ASSERT_EQ( vars.size(), 1 );
+  ASSERT_EQ( static_cast<const double*>(vars[0].data)[1], 7.0 ); // Filtered
+  SlothShmReader original(segment);
+  original.Snapshot(vars, values, time);
+  ASSERT_EQ( static_cast<const double*>(vars[0].data)[1], 2.0 );
+
+  std::remove(config_path.c_str());
+  std::remove(trace_path.c_str());
+}
+
+TEST(Sloth_Test, TestSlothSharedMemoryConfigErrors)
+{
+  std::string config_path = testing::TempDir() + "sloth_test_shm.cfg";
+  std::string segment = "/sloth_test_config_" + std::to_string(::getpid());
+  for(const char* size : { "-1", "abc", "16M", "0" }){
+    FILE* config = std::fopen(config_path.c_str(), "w");
+    std::fprintf(config, "shm_name=%s\nshm_size=%s\n", segment.c_str(), size);
+    std::fclose(config);
+    auto s = Sloth();
+    try {
+      s.Initialize(config_path);
+      FAIL() << "Accepted shm_size=" << size;
+    } catch(const std::runtime_error& e) {
+      ASSERT_NE( std::string(e.what()).find("shm_size"), std::string::npos );
+    }
+  }
+  std::remove(config_path.c_str());
+}
+#endif
+
+TEST(Sloth_Test, TestSlothAliasFilters)
+{
+  auto s = Sloth();
+  double init[4] = { 270.0, 270.0, 270.0, 270.0 };
+  s.SetValue("temp(4,double,K,node,T2D:nodata=-9999:fill=last:min=200:max=330)", init);
+  s.SetValue("temp_filled(4,double,K,node,T2D)", init); // Same alias, so the same filter
+  double precip_init[3] = { 0.0, 0.0, 0.0 };
+  s.SetValue("precip(3,float,mm,node,APCP:fill=0:min=0)", precip_init);
+  int flags_init[3] = { 0, 0, 0 };
+  s.SetValue("flags(3,int,1,node,FLAGS:nodata=-9999:fill=-1:max=9)", flags_init);
+
+  double t[4] = { 280.0, -9999.0, NAN, 500.0 };
+  s.SetValue("T2D", t);
+  double out[4];
+  s.GetValue("temp", out);
+  ASSERT_EQ( out[0], 280.0 );
+  ASSERT_EQ( out[1], 270.0 ); // Last good value
+  ASSERT_EQ( out[2], 270.0 );
+  ASSERT_EQ( out[3], 330.0 ); // Clamped
+  s.GetValue("temp_filled", out);
+  ASSERT_EQ( out[3], 330.0 );
+
+  float p[3] = { 1.5f, NAN, -2.0f };
+  s.SetValue("APCP", p);
+  float pout[3];
+  s.GetValue("precip", pout);
+  ASSERT_EQ( pout[0], 1.5f );
+  ASSERT_EQ( pout[1], 0.0f );
+  ASSERT_EQ( pout[2], 0.0f );
+
+  int f[3] = { 3, -9999, 42 };
+  s.SetValue("FLAGS", f);
+  int fout[3];
+  s.GetValue("flags", fout);
+  ASSERT_EQ( fout[0], 3 );
+  ASSERT_EQ( fout[1], -1 );
+  ASSERT_EQ( fout[2], 9 );
+
+  // Setting at indices is filtered too
+  double t2[2] = { -9999.0, 100.0 };
+  int inds[2] = { 0, 2 };
+  s.SetValueAtIndices("T2D", inds, 2, t2);
+  s.GetValue("temp", out);
+  ASSERT_EQ( out[0], 280.0 );
+  ASSERT_EQ( out[2], 200.0 );
+
+  // Without fill, missing values pass through rather than being clamped into range
+  double clamped_init[3] = { 0.0, 0.0, 0.0 };
+  s.SetValue("clamped(3,double,K,node,T2D_RAW:nodata=-9999:min=180:max=340)", clamped_init);
+  double raw[3] = { -9999.0, NAN, 400.0 };
+  s.SetValue("T2D_RAW", raw);
+  double cout[3];
+  s.GetValue("clamped", cout);
+  ASSERT_EQ( cout[0], -9999.0 );
+  ASSERT_TRUE( std::isnan(cout[1]) );
+  ASSERT_EQ( cout[2], 340.0 );
+
+  ASSERT_THROW( s.SetValue("bad(1,double,K,node,X:nodata=abc)", init), std::runtime_error );
+  ASSERT_THROW( s.SetValue("bad(1,double,K,node,X:sieve=1)", init), std::runtime_error );
+}
+
+TEST(Sloth_Test, TestSlothAliasFilterFromConfig)
+{
+  std::string config_path = testing::TempDir() + "sloth_test_filter.cfg";
+  FILE* config = std::fopen(config_path.c_str(), "w");
+  std::fprintf(config, "filter.T2D=nodata=-9999:fill=273.15\n");
+  std::fclose(config);
+
+  auto s = Sloth();
+  s.Initialize(config_path);
+  double v = 0.0;
+  s.SetValue("temp(1,double,K,node,T2D)", &v);
+  v = -9999.0;
+  s.SetValue("T2D", &v);
+  s.GetValue("temp", &v);
+  ASSERT_EQ( v, 273.15 );
+  std::remove(config_path.c_str());
+}
+
+TEST(Sloth_Test, TestSlothLargeArraySizes)
+{
+  auto s = Sloth();
+  // 2 GiB: too large for the int BMI signature. Storage is never touched, so is not actually committed.
+  s.GetVarItemCount64("big(268435456,double,1,node)");
+  ASSERT_EQ( s.GetVarNbytes64("big"), 2147483648LL );
+  ASSERT_EQ( s.GetVarItemCount64("big"), 268435456LL );
+  ASSERT_THROW( s.GetVarNbytes("big"), std::runtime_error );
+
+  ASSERT_EQ( s.GetVarNbytes("small(10,float,1,node)"), 40 );
+  ASSERT_EQ( s.GetVarNbytes64("small"), 40 );
+  ASSERT_THROW( s.GetVarNbytes("neg(-1,double,1,node)"), std::runtime_error );
+}
+
+TEST(Sloth_Test, TestSlothParallelCopy)
+{
+  auto s = Sloth();
+  // A tiny threshold so every copy goes through the pool; the odd count leaves a short final chunk.
+  s.ConfigureLargeArrays(true, 4, 1);
+  const size_t count = 1000003;
+  std::vector<double> in(count), out(count, 0.0);
+  for(size_t i = 0; i < count; ++i)
+    in[i] = (double)i;
+  s.SetValue("field(1000003,double,1,node)", in.data());
+  s.GetValue("field", out.data());
+  ASSERT_EQ( in, out );
+  ASSERT_EQ( ((double*)s.GetValuePtr("field"))[count - 1], (double)(count - 1) );
+
+  // Small variables still work, and the pool can be turned off again
+  double v = 1.5, w = 0.0;
+  s.SetValue("one", &v);
+  s.GetValue("one", &w);
+  ASSERT_EQ( w, 1.5 );
+  s.ConfigureLargeArrays(false, 0);
+  std::fill(out.begin(), out.end(), 0.0);
+  s.GetValue("field", out.data());
+  ASSERT_EQ( in, out );
+}
+
+TEST(Sloth_Test, TestSlothLargeArrayConfig)
+{
+  std::string config_path = testing::TempDir() + "sloth_test_large.cfg";
+  FILE* config = std::fopen(config_path.c_str(), "w");
+  std::fprintf(config, "copy_threads=3\nparallel_copy_threshold=0\nhuge_pages=true\n");
+  std::fclose(config);
+  auto s = Sloth();
+  s.Initialize(config_path);
+  double v = 2.5, w = 0.0;
+  s.SetValue("adouble", &v);
+  s.GetValue("adouble", &w);
+  ASSERT_EQ( w, 2.5 );
+
+  for(const char* setting : { "copy_threads=-1", "copy_threads=four", "parallel_copy_threshold=1e6", "huge_pages=yes" }){
+    config = std::fopen(config_path.c_str(), "w");
+    std::fprintf(config, "%s\n", setting);
+    std::fclose(config);
+    auto s2 = Sloth();
+    std::string key = std::string(setting).substr(0, std::string(setting).find('='));
+    try {
+      s2.Initialize(config_path);
+      FAIL() << "Accepted " << setting;
+    } catch(const std::runtime_error& e) {
+      ASSERT_NE( std::string(e.what()).find(key), std::string::npos );
+    }
+  }
+  std::remove(config_path.c_str());
+}
+
+TEST(Sloth_Test, TestSlothParallelCopyChunking)
+{
+  // Shapes where rounding each thread's share down (rather than up) would leave bytes uncopied
+  auto s = Sloth();
+  s.ConfigureLargeArrays(false, 16, 0);
+  double v = 42.0, w = 0.0;
+  s.SetValue("scalar", &v); // Fewer bytes than threads
+  s.GetValue("scalar", &w);
+  ASSERT_EQ( w, 42.0 );
+
+  std::vector<double> d(8193), dout(8193, 0.0); // 16 threads: 4096 bytes each plus 8 more
+  for(size_t i = 0; i < d.size(); ++i)
+    d[i] = (double)i + 1.0;
+  s.SetValue("doubles(8193,double,1,node)", d.data());
+  s.GetValue("doubles", dout.data());
+  ASSERT_EQ( d, dout );
+
+  auto s4 = Sloth();
+  s4.ConfigureLargeArrays(false, 4, 0);
+  std::vector<short> h(8193), hout(8193, 0); // 4 threads: 4096 bytes each plus 2 more
+  for(size_t i = 0; i < h.size(); ++i)
+    h[i] = (short)(i % 1000 + 1);
+  s4.SetValue("shorts(8193,short,1,node)", h.data());
+  s4.GetValue("shorts", hout.data());
+  ASSERT_EQ( h, hout );
+}